@@ -0,0 +1,406 @@
+/* correlate-times.cpp
+ * This file contains the routines that match the times the photos
+ * were taken to points of the tracks, one photo at a time or many.
+ *
+ * Matching many photos goes through them in a loop made for the
+ * options in use, so the options aren't tested again for every
+ * photo, and nor is whether the track's times are held compact for
+ * every point passed on the way.
+ */
+
+/* Copyright 2005-2018 Daniel Foote, Dan Fandrich.
+ * Copyright 2026 the gpscorrelate authors.
+ *
+ * This file is part of gpscorrelate.
+ *
+ * gpscorrelate is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * gpscorrelate is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with gpscorrelate; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <stdlib.h>
+#include <time.h>
+
+#include "gpsstructure.h"
+#include "track-index.h"
+#include "interpolate.h"
+#include "correlate.h"
+
+/* The options that change how a photo is matched, as the matching
+ * code sees them. FixedOptions has them built in, so code made with
+ * it has no tests of them at all; RuntimeOptions looks them up every
+ * time, for when it isn't worth making code for each. */
+template <bool Feather, bool NoInterpolate>
+struct FixedOptions {
+	static bool Feathered(const struct CorrelateOptions*)
+	{
+		return Feather;
+	}
+	static bool Rounded(const struct CorrelateOptions*)
+	{
+		return NoInterpolate;
+	}
+
+	/* Moves Next on to the first point of the span at or after
+	 * PhotoTime. Whether the times are compact is tested once here,
+	 * rather than for each point. */
+	static size_t Advance(const struct GPSTrack* Track,
+			const struct TrackSpan* Span, size_t Next, time_t PhotoTime)
+	{
+		if (Track->Time)
+		{
+			while (Next < Span->Past && Track->Time[Next] < PhotoTime)
+				Next++;
+		} else {
+			while (Next < Span->Past && GetTrackTime(Track, Next) < PhotoTime)
+				Next++;
+		}
+		return Next;
+	}
+};
+
+struct RuntimeOptions {
+	static bool Feathered(const struct CorrelateOptions* Options)
+	{
+		return Options->FeatherTime != 0;
+	}
+	static bool Rounded(const struct CorrelateOptions* Options)
+	{
+		return Options->NoInterpolate != 0;
+	}
+	static size_t Advance(const struct GPSTrack* Track,
+			const struct TrackSpan* Span, size_t Next, time_t PhotoTime)
+	{
+		while (Next < Span->Past && TRACK_TIME(Track, Next) < PhotoTime)
+			Next++;
+		return Next;
+	}
+};
+
+static void Round(const struct GPSTrack* Track, size_t First,
+		  struct GPSPoint* Result, time_t PhotoTime)
+{
+	/* Round the point between the two points - ie, it will end
+	 * up being one or the other point. */
+	size_t CopyFrom;
+
+	/* Determine the difference between the two points.
+	 * We're using the scale function used by interpolate.
+	 * This gives us a good view of where we are... */
+	time_t FirstTime = TRACK_TIME(Track, First);
+	double Scale = (double)TRACK_TIME(Track, First + 1) - (double)FirstTime;
+	Scale = ((double)PhotoTime - (double)FirstTime) / Scale;
+
+	/* Compare our scale. */
+	if (Scale <= 0.5)
+	{
+		/* Closer to the first point. */
+		CopyFrom = First;
+	} else {
+		/* Closer to the second point. */
+		CopyFrom = First + 1;
+	}
+
+	/* Copy the numbers over... */
+	GetTrackPoint(Track, CopyFrom, Result);
+
+	/* Done! */
+
+}
+
+/* Works out the point for a photo taken at PhotoTime from the span of
+ * a track that covers it, given the first point of the span at or after
+ * that time (or Span->Past if there isn't one). Returns one of the CORR_
+ * codes, and fills in Actual if it's a match, bar _INTERPOLATED, where
+ * the caller has to interpolate between Next - 1 and Next.
+ *
+ * Every point before Next is earlier than the photo, so only Next
+ * and the point before it can match. This is the same answer as
+ * going through the points one by one, skipping pairs with the same
+ * or a backwards timestamp, would give. A span never goes over the
+ * end of a segment unless we are interpolating between segments, so
+ * there's no need to check for that. */
+template <class Flags>
+static int MatchSpan(const struct GPSTrack* Track, const struct TrackSpan* Span,
+		size_t Next, time_t PhotoTime,
+		const struct CorrelateOptions* Options, struct GPSPoint* Actual)
+{
+	if (Next == Span->Past)
+	{
+		/* Every point is before the photo. */
+		return CORR_NOMATCH;
+	}
+
+	if (PhotoTime == TRACK_TIME(Track, Next))
+	{
+		/* This is the point, exactly.
+		 * Copy out the data and return that. */
+		GetTrackPoint(Track, Next, Actual);
+		return CORR_OK;
+	}
+
+	/* It is between the point before and this one. */
+	if (Next == Span->First)
+	{
+		return CORR_NOMATCH;
+	}
+
+	/* Sort of sanity check: is this photo inside our
+	 * "feather" time? If not, abort. */
+	if (Flags::Feathered(Options))
+	{
+		if (((TRACK_TIME(Track, Next - 1) + Options->FeatherTime) < PhotoTime) &&
+			((TRACK_TIME(Track, Next) - Options->FeatherTime) > PhotoTime))
+		{
+			/* We are inside the feather
+			 * time between two points.
+			 * Abort. */
+			return CORR_TOOFAR;
+		}
+	} /* endif (Options->Feather) */
+
+	/* Unless told otherwise, we interpolate.
+	 * If not interpolating, we round to nearest.
+	 * If points are equidistant, we round down. */
+	if (Flags::Rounded(Options))
+	{
+		/* No interpolation. Round. */
+		Round(Track, Next - 1, Actual, PhotoTime);
+		return CORR_ROUND;
+	} else {
+		/* Interpolate away! (Or rather, leave it to the caller,
+		 * which might have a lot of them to do.) */
+		return CORR_INTERPOLATED;
+	}
+}
+
+/* Answers for a photo from the coverage map, if it rules the photo
+ * out. Returns 1 if it did. */
+static int RuleOut(time_t PhotoTime, const struct CorrelateOptions* Options,
+		struct CorrelateResult* Result)
+{
+	int Coverage = CheckCoverage(Options->Index, PhotoTime);
+
+	Result->RuledOut = (Coverage != COVERAGE_UNKNOWN);
+	Result->Result = (Coverage == COVERAGE_GAP) ? CORR_TOOFAR : CORR_NOMATCH;
+	return Result->RuledOut;
+}
+
+void CorrelateTime(time_t PhotoTime, const struct CorrelateOptions* Options,
+		struct CorrelateResult* Result)
+{
+	const struct TrackSpan* Span;
+	const struct GPSTrack* Track;
+	size_t Next;
+
+	/* The coverage map rules out most photos that can't match
+	 * without having to search for them. */
+	if (RuleOut(PhotoTime, Options, Result))
+		return;
+
+	/* Look up the track segment (or track, if we are matching
+	 * between segments) whose times cover the photo. Can't really
+	 * match it if we were not logging when it was taken. Where
+	 * more than one does, the first in the list of tracks wins. */
+	Span = FindTrackSpan(Options->Index, PhotoTime);
+	if (!Span) {
+		/* All tracks were outside the time range. */
+		Result->Result = CORR_NOMATCH;
+		return;
+	}
+
+	/* Time to find where in the span our PhotoTime is. It might
+	 * be between two points, or exactly on a point... even better... */
+	Track = &Options->Track[Span->Track];
+	Next = FindTrackTime(Track, Span->First, Span->Past, PhotoTime);
+	Result->Result = MatchSpan<RuntimeOptions>(Track, Span, Next, PhotoTime,
+						   Options, &Result->Point);
+	if (Result->Result == CORR_INTERPOLATED)
+		InterpolatePoint(Track, Next - 1, PhotoTime, &Result->Point);
+}
+
+/* A photo waiting to be matched by CorrelateTimes */
+struct WaitingPhoto {
+	time_t Time;
+	size_t Index;	/* Where it is in the caller's arrays */
+};
+
+static int ComparePhotoTimes(const void* A, const void* B)
+{
+	const struct WaitingPhoto* PA = (const struct WaitingPhoto*) A;
+	const struct WaitingPhoto* PB = (const struct WaitingPhoto*) B;
+
+	if (PA->Time < PB->Time)
+		return -1;
+	return PA->Time > PB->Time;
+}
+
+/* Photos waiting to be interpolated by CorrelateTimes, all between
+ * points of the same track */
+struct InterpolateQueue {
+	const struct GPSTrack* Track;
+	size_t* First;		/* The point before each photo */
+	time_t* Times;
+	size_t* Index;		/* Where each is in the caller's arrays */
+	struct GPSPoint* Points;
+	size_t Count;
+	int Kernel;		/* Which of the INTERPOLATE_ kernels to use */
+};
+
+/* Interpolates all the photos in the queue at once, and empties it. */
+static void FlushQueue(struct InterpolateQueue* Queue,
+		struct CorrelateResult* Results)
+{
+	size_t i;
+
+	InterpolatePoints(Queue->Kernel, Queue->Track, Queue->First,
+			  Queue->Times, Queue->Count, Queue->Points);
+	for (i = 0; i < Queue->Count; i++)
+		Results[Queue->Index[i]].Point = Queue->Points[i];
+	Queue->Count = 0;
+}
+
+/* Matches the photos, sorted by time, with Next holding the first point
+ * of each span. This is where CorrelateTimes spends its time, so there's
+ * one made for each combination of options.
+ *
+ * Go through the photos in order of time, keeping track of the
+ * first point at or after the last photo in each span. The first
+ * point at or after a photo can only be further on for a later
+ * photo, even if the points are out of order, so each span is
+ * only gone through once. Photos to interpolate are put off until
+ * the next one is for another track, to do them all together. */
+template <class Flags>
+static void MatchPhotos(const struct WaitingPhoto* Photos, size_t NumPhotos,
+		const struct CorrelateOptions* Options, size_t* Next,
+		struct InterpolateQueue* Queue, struct CorrelateResult* Results)
+{
+	size_t i;
+
+	for (i = 0; i < NumPhotos; i++)
+	{
+		time_t PhotoTime = Photos[i].Time;
+		size_t Index = Photos[i].Index;
+		const struct TrackSpan* Span;
+		const struct GPSTrack* Track;
+		size_t* SpanNext;
+
+		if (RuleOut(PhotoTime, Options, &Results[Index]))
+			continue;
+		Span = FindTrackSpan(Options->Index, PhotoTime);
+		if (!Span)
+		{
+			Results[Index].Result = CORR_NOMATCH;
+			continue;
+		}
+		Track = &Options->Track[Span->Track];
+		SpanNext = &Next[Span - Options->Index->Spans];
+		*SpanNext = Flags::Advance(Track, Span, *SpanNext, PhotoTime);
+		Results[Index].Result = MatchSpan<Flags>(Track, Span, *SpanNext,
+				PhotoTime, Options, &Results[Index].Point);
+		if (Results[Index].Result != CORR_INTERPOLATED)
+			continue;
+
+		if (Queue->Count && Queue->Track != Track)
+			FlushQueue(Queue, Results);
+		Queue->Track = Track;
+		Queue->First[Queue->Count] = *SpanNext - 1;
+		Queue->Times[Queue->Count] = PhotoTime;
+		Queue->Index[Queue->Count] = Index;
+		Queue->Count++;
+	}
+	if (Queue->Count)
+		FlushQueue(Queue, Results);
+}
+
+/* Does the work of CorrelateTimes, with a loop made for the options if
+ * Specialize is set, or else the one that tests them as it goes. */
+static int MatchTimes(const time_t* PhotoTimes, size_t NumPhotos,
+		const struct CorrelateOptions* Options,
+		struct CorrelateResult* Results, bool Specialize)
+{
+	struct WaitingPhoto* Photos;
+	struct InterpolateQueue Queue;
+	size_t* Next;
+	size_t i;
+
+	if (NumPhotos == 0)
+		return 1;
+	Photos = (struct WaitingPhoto*) malloc(NumPhotos * sizeof(*Photos));
+	Next = (size_t*) malloc((Options->Index->NumSpans + 1) * sizeof(*Next));
+	Queue.Track = NULL;
+	Queue.First = (size_t*) malloc(NumPhotos * sizeof(*Queue.First));
+	Queue.Times = (time_t*) malloc(NumPhotos * sizeof(*Queue.Times));
+	Queue.Index = (size_t*) malloc(NumPhotos * sizeof(*Queue.Index));
+	Queue.Points = (struct GPSPoint*) malloc(NumPhotos * sizeof(*Queue.Points));
+	Queue.Count = 0;
+	Queue.Kernel = BestInterpolateKernel();
+	if (!Photos || !Next || !Queue.First || !Queue.Times || !Queue.Index ||
+	    !Queue.Points)
+	{
+		free(Photos);
+		free(Next);
+		free(Queue.First);
+		free(Queue.Times);
+		free(Queue.Index);
+		free(Queue.Points);
+		return 0;
+	}
+
+	for (i = 0; i < NumPhotos; i++)
+	{
+		Photos[i].Time = PhotoTimes[i];
+		Photos[i].Index = i;
+	}
+	qsort(Photos, NumPhotos, sizeof(*Photos), ComparePhotoTimes);
+	for (i = 0; i < Options->Index->NumSpans; i++)
+		Next[i] = Options->Index->Spans[i].First;
+
+	if (!Specialize)
+		MatchPhotos<RuntimeOptions>(Photos, NumPhotos, Options, Next,
+					    &Queue, Results);
+	else if (Options->FeatherTime && Options->NoInterpolate)
+		MatchPhotos<FixedOptions<true, true> >(Photos, NumPhotos, Options,
+						       Next, &Queue, Results);
+	else if (Options->FeatherTime)
+		MatchPhotos<FixedOptions<true, false> >(Photos, NumPhotos, Options,
+							Next, &Queue, Results);
+	else if (Options->NoInterpolate)
+		MatchPhotos<FixedOptions<false, true> >(Photos, NumPhotos, Options,
+							Next, &Queue, Results);
+	else
+		MatchPhotos<FixedOptions<false, false> >(Photos, NumPhotos, Options,
+							 Next, &Queue, Results);
+
+	free(Photos);
+	free(Next);
+	free(Queue.First);
+	free(Queue.Times);
+	free(Queue.Index);
+	free(Queue.Points);
+	return 1;
+}
+
+int CorrelateTimes(const time_t* PhotoTimes, size_t NumPhotos,
+		const struct CorrelateOptions* Options,
+		struct CorrelateResult* Results)
+{
+	return MatchTimes(PhotoTimes, NumPhotos, Options, Results, true);
+}
+
+int CorrelateTimesGeneric(const time_t* PhotoTimes, size_t NumPhotos,
+		const struct CorrelateOptions* Options,
+		struct CorrelateResult* Results)
+{
+	return MatchTimes(PhotoTimes, NumPhotos, Options, Results, false);
+}
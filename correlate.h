@@ -25,6 +25,10 @@
  * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
  */
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 /* A structure of options to pass to the correlate function.
  * Not really sure if this is needed, but... */
 struct CorrelateOptions {
@@ -48,6 +52,8 @@ struct CorrelateOptions {
 
 	struct GPSTrack *Track; /* Pointer to array of tracks to use. The last
 				   track must be entirely zeros. */
+	struct TrackIndex *Index; /* Index of Track, from BuildTrackIndex with
+				     the same DoBetweenTrkSeg and FeatherTime. */
 };
 
 /* Return codes in order:
@@ -76,9 +82,59 @@ struct CorrelateOptions {
 #define CORR_GPSDATAEXISTS  8
 
 
+/* What CorrelateTime found for a photo */
+struct CorrelateResult {
+	int Result;		/* One of _OK, _INTERPOLATED, _ROUND, _NOMATCH
+				   or _TOOFAR */
+	int RuledOut;		/* Set if the coverage map gave the answer */
+	struct GPSPoint Point;	/* The point, unless _NOMATCH or _TOOFAR */
+};
+
+/* Reads the time from a photo, matches it against the tracks and writes
+ * the point into it, returning a copy of the point. */
 struct GPSPoint* CorrelatePhoto(const char* Filename, 
 		struct CorrelateOptions* Options);
+
+/* The steps of CorrelatePhoto, for matching many photos at once.
+ * ReadPhotoTime gets the time a photo was taken, in the same time as the
+ * GPS data. It returns 0 with Options->Result set to _NOEXIFINPUT or
+ * _GPSDATAEXISTS if the photo can't be matched.
+ * CorrelateTime matches a photo time against the tracks into Result.
+ * It doesn't change Options, read or write any files, or allocate any
+ * memory, so it can be called from any number of threads at once.
+ * CorrelateTimes matches NumPhotos photo times against the tracks just
+ * as CorrelateTime would, but sorts them and goes through each track
+ * segment just once. Results are in the order the times were given.
+ * Returns 0 if there isn't the memory.
+ * PhotoTimeFromExif is ReadPhotoTime given what ReadExifDate read
+ * from the photo, for when that's done elsewhere.
+ * WritePhotoPoint writes a matched point into a photo, unless
+ * NoWriteExif is set. Returns 0 if it couldn't. */
+int ReadPhotoTime(const char* Filename, struct CorrelateOptions* Options,
+		time_t* PhotoTime);
+int PhotoTimeFromExif(const char* TimeTemp, int IncludesGPS,
+		struct CorrelateOptions* Options, time_t* PhotoTime);
+void CorrelateTime(time_t PhotoTime, const struct CorrelateOptions* Options,
+		struct CorrelateResult* Result);
+int CorrelateTimes(const time_t* PhotoTimes, size_t NumPhotos,
+		const struct CorrelateOptions* Options,
+		struct CorrelateResult* Results);
+int WritePhotoPoint(const char* Filename, const struct GPSPoint* Point,
+		const struct CorrelateOptions* Options);
+
+/* CorrelateTimes as it would be with one loop for all the options,
+ * testing them as it goes, rather than one made for the options in use.
+ * It gives just the same results, a little more slowly, and is only
+ * there to compare CorrelateTimes with. */
+int CorrelateTimesGeneric(const time_t* PhotoTimes, size_t NumPhotos,
+		const struct CorrelateOptions* Options,
+		struct CorrelateResult* Results);
+
 void SetAutoTimeZoneOptions(const char *TimeTemp,
 		struct CorrelateOptions* Options);
 time_t ConvertTimeToUnixTime(const char *TimeTemp, const char *TimeFormat,
 		const struct CorrelateOptions* Options);
+
+#ifdef __cplusplus
+}
+#endif
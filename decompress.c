@@ -0,0 +1,348 @@
+/* decompress.c
+ * This file contains routines for reading compressed files a piece at a
+ * time, so they can be parsed as they are decompressed without ever
+ * having the whole of the uncompressed data on disk or in memory. Files
+ * that aren't compressed can be read the same way, for readers that
+ * don't care either way.
+ *
+ * The format is recognised from the first few bytes of the file, not
+ * from its name. Each format is only supported if the library for it was
+ * available at build time (HAVE_ZLIB, HAVE_LZMA and HAVE_ZSTD). Several
+ * compressed streams one after another in the same file are read as one,
+ * as the command line tools do.
+ */
+
+/* Copyright 2026 the gpscorrelate authors.
+ *
+ * This file is part of gpscorrelate.
+ *
+ * gpscorrelate is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * gpscorrelate is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with gpscorrelate; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef HAVE_LZMA
+#include <lzma.h>
+#endif
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#include "i18n.h"
+#include "decompress.h"
+#include "track-load.h"
+
+/* Size of the buffer for compressed data read from the file */
+#define IN_SIZE 65536
+
+enum Format {
+	FORMAT_NONE,
+	FORMAT_GZIP,
+	FORMAT_XZ,
+	FORMAT_ZSTD
+};
+
+struct Decompressor {
+	FILE* File;
+	char* Name;
+	enum Format Format;
+	unsigned char In[IN_SIZE];
+	size_t InPos;		/* Next byte of In to be decompressed */
+	size_t InLen;		/* Bytes of In that are filled */
+	int InEof;		/* Set once the whole file has been read */
+	int Finished;		/* Set once all the data has been returned */
+	int Error;
+	int Quiet;		/* Don't report errors */
+#ifdef HAVE_ZLIB
+	z_stream Gzip;
+#endif
+#ifdef HAVE_LZMA
+	lzma_stream Xz;
+#endif
+#ifdef HAVE_ZSTD
+	ZSTD_DCtx* Zstd;
+#endif
+};
+
+/* Reads more of the file into In once it has all been used up. */
+static void FillInput(struct Decompressor* D)
+{
+	if (D->InPos < D->InLen || D->InEof)
+		return;
+	D->InPos = 0;
+	D->InLen = fread(D->In, 1, sizeof(D->In), D->File);
+	if (D->InLen == 0) {
+		if (ferror(D->File))
+			D->Error = 1;
+		D->InEof = 1;
+	}
+}
+
+#if defined(HAVE_ZLIB) || defined(HAVE_LZMA) || defined(HAVE_ZSTD)
+/* Returns 1 if In starts with the given bytes. */
+static int HasMagic(const struct Decompressor* D, const char* Magic, size_t Len)
+{
+	return D->InLen >= Len && memcmp(D->In, Magic, Len) == 0;
+}
+#endif
+
+/* Decompresses as much as possible of the input into Out. On return,
+ * *InUsed and *OutLen are set to how much of each was used. Returns 1 at
+ * the end of a compressed stream, 0 if there's more to come or -1 on
+ * error. */
+static int Step(struct Decompressor* D, size_t* InUsed, unsigned char* Out,
+		size_t* OutLen)
+{
+	switch (D->Format) {
+#ifdef HAVE_ZLIB
+	case FORMAT_GZIP: {
+		int Ret;
+		D->Gzip.next_in = D->In + D->InPos;
+		D->Gzip.avail_in = (uInt) *InUsed;
+		D->Gzip.next_out = Out;
+		D->Gzip.avail_out = (uInt) *OutLen;
+		Ret = inflate(&D->Gzip, Z_NO_FLUSH);
+		*InUsed -= D->Gzip.avail_in;
+		*OutLen -= D->Gzip.avail_out;
+		if (Ret == Z_STREAM_END)
+			return 1;
+		return (Ret == Z_OK || Ret == Z_BUF_ERROR) ? 0 : -1;
+	}
+#endif
+#ifdef HAVE_LZMA
+	case FORMAT_XZ: {
+		lzma_ret Ret;
+		D->Xz.next_in = D->In + D->InPos;
+		D->Xz.avail_in = *InUsed;
+		D->Xz.next_out = Out;
+		D->Xz.avail_out = *OutLen;
+		/* Concatenated streams only end once it's told there's no
+		 * more input. */
+		Ret = lzma_code(&D->Xz, D->InEof ? LZMA_FINISH : LZMA_RUN);
+		*InUsed -= D->Xz.avail_in;
+		*OutLen -= D->Xz.avail_out;
+		if (Ret == LZMA_STREAM_END)
+			return 1;
+		return (Ret == LZMA_OK || Ret == LZMA_BUF_ERROR) ? 0 : -1;
+	}
+#endif
+#ifdef HAVE_ZSTD
+	case FORMAT_ZSTD: {
+		ZSTD_inBuffer InBuf;
+		ZSTD_outBuffer OutBuf;
+		size_t Ret;
+		InBuf.src = D->In + D->InPos;
+		InBuf.size = *InUsed;
+		InBuf.pos = 0;
+		OutBuf.dst = Out;
+		OutBuf.size = *OutLen;
+		OutBuf.pos = 0;
+		Ret = ZSTD_decompressStream(D->Zstd, &OutBuf, &InBuf);
+		*InUsed = InBuf.pos;
+		*OutLen = OutBuf.pos;
+		if (ZSTD_isError(Ret))
+			return -1;
+		return Ret == 0 ? 1 : 0;
+	}
+#endif
+	default:
+		(void) InUsed;
+		(void) Out;
+		(void) OutLen;
+		return -1;
+	}
+}
+
+/* Opens a file and sets up to decompress it. If it isn't compressed,
+ * returns NULL or, if Plain is set, a reader for the file as it is. */
+static struct Decompressor* Open(const char* File, int Plain)
+{
+	struct Decompressor* D = (struct Decompressor*) calloc(1, sizeof(*D));
+	int Ok = Plain;
+
+	if (D == NULL)
+		return NULL;
+	D->File = fopen(File, "rb");
+	if (D->File == NULL) {
+		free(D);
+		return NULL;
+	}
+	FillInput(D);
+
+#ifdef HAVE_ZLIB
+	if (HasMagic(D, "\x1f\x8b", 2)) {
+		D->Format = FORMAT_GZIP;
+		/* 16 means a gzip header is expected */
+		Ok = inflateInit2(&D->Gzip, 16 + MAX_WBITS) == Z_OK;
+	}
+#endif
+#ifdef HAVE_LZMA
+	if (HasMagic(D, "\xfd" "7zXZ\0", 6)) {
+		lzma_stream Init = LZMA_STREAM_INIT;
+		D->Format = FORMAT_XZ;
+		D->Xz = Init;
+		Ok = lzma_stream_decoder(&D->Xz, UINT64_MAX, LZMA_CONCATENATED) == LZMA_OK;
+	}
+#endif
+#ifdef HAVE_ZSTD
+	if (HasMagic(D, "\x28\xb5\x2f\xfd", 4)) {
+		D->Format = FORMAT_ZSTD;
+		D->Zstd = ZSTD_createDCtx();
+		Ok = D->Zstd != NULL;
+	}
+#endif
+
+	if (!Ok) {
+		/* Not compressed, or at least not in a way we know */
+		fclose(D->File);
+		free(D);
+		return NULL;
+	}
+	D->Name = strdup(File);
+	return D;
+}
+
+struct Decompressor* OpenCompressed(const char* File)
+{
+	return Open(File, 0);
+}
+
+struct Decompressor* OpenDecompressed(const char* File)
+{
+	return Open(File, 1);
+}
+
+/* Copies data straight out of a file that isn't compressed. */
+static int ReadPlain(struct Decompressor* D, char* Buffer, int Len)
+{
+	size_t Done = 0;
+
+	while (!D->Error && Done < (size_t) Len) {
+		size_t Part;
+
+		FillInput(D);
+		if (D->InPos == D->InLen)
+			break;
+		Part = D->InLen - D->InPos;
+		if (Part > (size_t) Len - Done)
+			Part = (size_t) Len - Done;
+		memcpy(Buffer + Done, D->In + D->InPos, Part);
+		D->InPos += Part;
+		Done += Part;
+	}
+
+	if (D->Error) {
+		if (D->Error == 1 && !D->Quiet)
+			TrackReadError(_("Error reading %s.\n"), D->Name);
+		D->Error = 2;
+		return -1;
+	}
+	return (int) Done;
+}
+
+int ReadCompressed(struct Decompressor* D, char* Buffer, int Len)
+{
+	size_t Done = 0;
+
+	if (D->Format == FORMAT_NONE)
+		return ReadPlain(D, Buffer, Len);
+
+	while (!D->Error && !D->Finished && Done < (size_t) Len) {
+		size_t InUsed;
+		size_t OutLen = (size_t) Len - Done;
+		int Ret;
+
+		FillInput(D);
+		InUsed = D->InLen - D->InPos;
+		Ret = Step(D, &InUsed, (unsigned char*) Buffer + Done, &OutLen);
+		D->InPos += InUsed;
+		Done += OutLen;
+
+		if (Ret < 0) {
+			D->Error = 1;
+		} else if (Ret > 0) {
+			/* That's the end of one stream, but there may be
+			 * another one after it. */
+			FillInput(D);
+			if (D->InPos == D->InLen) {
+				D->Finished = 1;
+#ifdef HAVE_ZLIB
+			} else if (D->Format == FORMAT_GZIP) {
+				inflateReset(&D->Gzip);
+#endif
+			}
+		} else if (InUsed == 0 && OutLen == 0) {
+			/* It's stuck, which means the data was cut short */
+			D->Error = 1;
+		}
+	}
+
+	if (D->Error) {
+		if (D->Error == 1 && !D->Quiet)
+			TrackReadError(_("Error decompressing %s.\n"), D->Name);
+		/* Only say so once */
+		D->Error = 2;
+		return -1;
+	}
+	return (int) Done;
+}
+
+void CloseCompressed(struct Decompressor* D)
+{
+	if (D == NULL)
+		return;
+	switch (D->Format) {
+#ifdef HAVE_ZLIB
+	case FORMAT_GZIP:
+		inflateEnd(&D->Gzip);
+		break;
+#endif
+#ifdef HAVE_LZMA
+	case FORMAT_XZ:
+		lzma_end(&D->Xz);
+		break;
+#endif
+#ifdef HAVE_ZSTD
+	case FORMAT_ZSTD:
+		ZSTD_freeDCtx(D->Zstd);
+		break;
+#endif
+	default:
+		break;
+	}
+	fclose(D->File);
+	free(D->Name);
+	free(D);
+}
+
+int PeekFile(const char* File, char* Buffer, int Len)
+{
+	struct Decompressor* D = OpenDecompressed(File);
+	int Got;
+
+	if (D == NULL)
+		return -1;
+	/* Any problem with the data will be reported when it's read for
+	 * real. */
+	D->Quiet = 1;
+	Got = ReadCompressed(D, Buffer, Len);
+	CloseCompressed(D);
+	return Got;
+}
@@ -0,0 +1,49 @@
+/* decompress.h
+ * This file contains prototypes for the functions
+ * in decompress.c.
+ */
+
+/* Copyright 2026 the gpscorrelate authors.
+ *
+ * This file is part of gpscorrelate.
+ *
+ * gpscorrelate is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * gpscorrelate is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with gpscorrelate; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+struct Decompressor;
+
+/* Opens a file and looks at its first few bytes to see whether it has
+ * been compressed in a format we can read (gzip, xz or zstd, depending
+ * on what was available at build time). Returns a decompressor ready to
+ * read the uncompressed data, or NULL if the file isn't compressed or
+ * can't be opened, in which case it should just be read as it is. */
+struct Decompressor* OpenCompressed(const char* File);
+
+/* Opens a file to be read with ReadCompressed whether it's compressed or
+ * not. Returns NULL only if the file can't be opened. */
+struct Decompressor* OpenDecompressed(const char* File);
+
+/* Reads up to Len bytes of uncompressed data into Buffer. Returns the
+ * number of bytes read, 0 at the end of the data or -1 on error, which
+ * will have been reported. Fewer than Len bytes are only returned at the
+ * end of the data. */
+int ReadCompressed(struct Decompressor* D, char* Buffer, int Len);
+
+void CloseCompressed(struct Decompressor* D);
+
+/* Reads up to Len bytes from the start of a file into Buffer, after
+ * decompressing it if need be, to see what sort of file it is. Returns
+ * the number of bytes read, or -1 if the file can't be read. */
+int PeekFile(const char* File, char* Buffer, int Len);
@@ -169,11 +169,13 @@ char* ReadExifData(const char* File, double* Lat, double* Long, double* Elev, in
 
 	try {
 		Image = Exiv2::ImageFactory::open(File);
+		// This is also used on whole directories of photos, so a
+		// corrupt one mustn't bring everything down.
+		Image->readMetadata();
 	} catch (Exiv2::Error& e) {
-		DEBUGLOG("Failed to open file %s.\n", File);
+		DEBUGLOG("Failed to read file %s.\n", File);
 		return NULL;
 	}
-	Image->readMetadata();
 	if (Image.get() == NULL)
 	{
 		DEBUGLOG("Failed to read file %s %s.\n",
@@ -455,6 +457,18 @@ static void ConvertToOldLatLongRational(double Number, char *Buf, int BufSize)
 	//printf("Old style lat/long: %f -> %s\n", Number, Buf);
 }
 
+/* Splits a time up into the UTC date and time. gmtime() would hand back
+ * the one buffer shared by every thread, and photos can be written on
+ * several threads at once. */
+static void SplitUTCTime(time_t Time, struct tm* Tm)
+{
+#ifdef _WIN32
+	gmtime_s(Tm, &Time);
+#else
+	gmtime_r(&Time, Tm);
+#endif
+}
+
 static void replace(Exiv2::ExifData &exif, Exiv2::ExifKey key, const Exiv2::Value *value)
 {
 	Exiv2::ExifData::iterator it = exif.findKey(key);
@@ -609,7 +623,8 @@ int WriteGPSData(const char* File, const struct GPSPoint* Point,
 	// Make up the timestamp...
 	// The timestamp is taken as the UTC time of the photo.
 	// If interpolation occurred, then this time is the time of the photo.
-	struct tm TimeStamp = *gmtime(&(Point->Time));
+	struct tm TimeStamp;
+	SplitUTCTime(Point->Time, &TimeStamp);
 
 	Value = Exiv2::Value::create(Exiv2::unsignedRational);
 	snprintf(ScratchBuf, sizeof(ScratchBuf), "%d/1 %d/1 %d/1",
@@ -675,7 +690,8 @@ int WriteFixedDatestamp(const char* File, time_t Time)
 
 	Exiv2::ExifData &ExifToWrite = Image->exifData();
 
-	const struct tm TimeStamp = *gmtime(&Time);
+	struct tm TimeStamp;
+	SplitUTCTime(Time, &TimeStamp);
 	char ScratchBuf[100];
 
 	snprintf(ScratchBuf, sizeof(ScratchBuf), "%04d:%02d:%02d",
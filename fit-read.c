@@ -0,0 +1,380 @@
+/* fit-read.c
+ * This file contains routines for reading the track from a FIT file, the
+ * binary format used by Garmin and many other fitness devices.
+ *
+ * A FIT file is a series of messages. Definition messages describe the
+ * layout of the data messages that follow them, and each point of the
+ * track is in a data message of the "record" type. Only the position,
+ * altitude and time are taken from these. Timer stop events end the
+ * track segment. The file is decoded as it's read, a block at a time,
+ * and may be compressed. Several FIT files joined together are read as
+ * one.
+ */
+
+/* Copyright 2026 the gpscorrelate authors.
+ *
+ * This file is part of gpscorrelate.
+ *
+ * gpscorrelate is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * gpscorrelate is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with gpscorrelate; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "i18n.h"
+#include "fit-read.h"
+#include "decompress.h"
+#include "track-load.h"
+#include "gpsstructure.h"
+
+/* Size of the buffer the file is read into */
+#define FIT_BUFFER 65536
+
+/* FIT times are seconds since 1989-12-31 00:00:00 UTC */
+#define FIT_EPOCH 631065600L
+
+/* Global message numbers */
+#define MESG_RECORD 20
+#define MESG_EVENT 21
+
+/* Field numbers */
+#define FIELD_TIMESTAMP 253	/* In any message */
+#define RECORD_LAT 0
+#define RECORD_LONG 1
+#define RECORD_ALTITUDE 2
+#define RECORD_ENHANCED_ALTITUDE 78
+#define EVENT_EVENT 0
+#define EVENT_TYPE 1
+
+#define EVENT_TIMER 0
+#define EVENT_TYPE_STOP 1
+#define EVENT_TYPE_STOP_ALL 4
+#define EVENT_TYPE_STOP_DISABLE 8
+#define EVENT_TYPE_STOP_DISABLE_ALL 9
+
+/* Positions are in semicircles, of which there are 2^31 in 180 degrees.
+ * That's a bit finer than 7 decimal places. */
+#define SEMICIRCLE (180.0 / 2147483648.0)
+#define POSITION_DECIMALS 7
+/* Altitudes are in fifths of a metre, from 500 m below sea level */
+#define ALTITUDE_DECIMALS 1
+
+#define LOCAL_TYPES 16
+#define MAX_FIELDS 255
+
+struct FitField {
+	unsigned char Num;
+	unsigned char Size;
+};
+
+/* The layout of the data messages of one local message type */
+struct FitDefinition {
+	int Defined;
+	int BigEndian;
+	unsigned Global;	/* Global message number */
+	int NumFields;
+	struct FitField Fields[MAX_FIELDS];
+	size_t Size;		/* Of a whole data message */
+};
+
+struct FitReader {
+	struct Decompressor* In;
+	unsigned char Buffer[FIT_BUFFER];
+	size_t Pos;
+	size_t Len;
+	int Error;		/* Reading failed, and has been reported */
+
+	unsigned Crc;		/* Of everything read since the file header began */
+	uint32_t Count;		/* Bytes read since the end of the file header */
+
+	struct FitDefinition Defs[LOCAL_TYPES];
+	/* Room for the biggest possible message, with developer fields */
+	unsigned char Message[2 * MAX_FIELDS * 255];
+
+	uint32_t Timestamp;	/* Latest time seen */
+	int HaveTimestamp;
+
+	struct GPSTrack Points;
+};
+
+/* CRC of four bits at a time, as given in the FIT specification */
+static const unsigned CrcTable[16] = {
+	0x0000, 0xCC01, 0xD801, 0x1400, 0xF001, 0x3C00, 0x2800, 0xE401,
+	0xA001, 0x6C00, 0x7800, 0xB401, 0x5000, 0x9C01, 0x8801, 0x4400
+};
+
+static unsigned UpdateCrc(unsigned Crc, const unsigned char* Data, size_t Len)
+{
+	size_t i;
+
+	for (i = 0; i < Len; i++) {
+		Crc = (Crc >> 4) ^ CrcTable[Crc & 0xF] ^ CrcTable[Data[i] & 0xF];
+		Crc = (Crc >> 4) ^ CrcTable[Crc & 0xF] ^ CrcTable[Data[i] >> 4];
+	}
+	return Crc;
+}
+
+int IsFIT(const char* Start, size_t Len)
+{
+	return Len >= 12 && (Start[0] == 12 || Start[0] == 14) &&
+		memcmp(Start + 8, ".FIT", 4) == 0;
+}
+
+/* Reads the next Len bytes of the file. Returns 0 if there aren't that
+ * many left. */
+static int GetBytes(struct FitReader* R, unsigned char* Out, size_t Len)
+{
+	unsigned char* Start = Out;
+	size_t Want = Len;
+
+	while (Len > 0) {
+		size_t Part;
+
+		if (R->Pos == R->Len) {
+			int Got = ReadCompressed(R->In, (char*) R->Buffer, FIT_BUFFER);
+			if (Got <= 0) {
+				if (Got < 0)
+					R->Error = 1;
+				return 0;
+			}
+			R->Pos = 0;
+			R->Len = (size_t) Got;
+		}
+		Part = R->Len - R->Pos;
+		if (Part > Len)
+			Part = Len;
+		memcpy(Out, R->Buffer + R->Pos, Part);
+		R->Pos += Part;
+		Out += Part;
+		Len -= Part;
+	}
+
+	R->Crc = UpdateCrc(R->Crc, Start, Want);
+	R->Count += (uint32_t) Want;
+	return 1;
+}
+
+/* Returns an unsigned value of 1, 2 or 4 bytes */
+static uint32_t GetValue(const unsigned char* p, int Size, int BigEndian)
+{
+	uint32_t Value = 0;
+	int i;
+
+	for (i = 0; i < Size; i++)
+		Value |= (uint32_t) p[BigEndian ? Size - 1 - i : i] << (8 * i);
+	return Value;
+}
+
+static int ReadDefinition(struct FitReader* R, int Local, int HasDeveloperFields)
+{
+	struct FitDefinition* D = &R->Defs[Local];
+	unsigned char Fixed[5];
+	unsigned char Raw[MAX_FIELDS * 3];
+	unsigned char NumDeveloperFields;
+	int i;
+
+	/* Reserved byte, architecture, global message number, fields */
+	if (!GetBytes(R, Fixed, sizeof(Fixed)) || Fixed[1] > 1)
+		return 0;
+	D->BigEndian = Fixed[1];
+	D->Global = GetValue(Fixed + 2, 2, D->BigEndian);
+	D->NumFields = Fixed[4];
+	if (!GetBytes(R, Raw, D->NumFields * 3))
+		return 0;
+
+	D->Size = 0;
+	for (i = 0; i < D->NumFields; i++) {
+		D->Fields[i].Num = Raw[i * 3];
+		D->Fields[i].Size = Raw[i * 3 + 1];
+		D->Size += Raw[i * 3 + 1];
+	}
+
+	/* Developer fields are skipped, so only their size matters */
+	if (HasDeveloperFields) {
+		if (!GetBytes(R, &NumDeveloperFields, 1) ||
+		    !GetBytes(R, Raw, NumDeveloperFields * 3))
+			return 0;
+		for (i = 0; i < NumDeveloperFields; i++)
+			D->Size += Raw[i * 3 + 1];
+	}
+
+	D->Defined = 1;
+	return 1;
+}
+
+static int ReadData(struct FitReader* R, int Local)
+{
+	const struct FitDefinition* D = &R->Defs[Local];
+	const unsigned char* p = R->Message;
+	struct GPSPoint Point;
+	uint32_t Lat = 0x7FFFFFFF;
+	uint32_t Long = 0x7FFFFFFF;
+	uint32_t Altitude = 0xFFFFFFFF;
+	unsigned Event = 0xFF;
+	unsigned EventType = 0xFF;
+	int i;
+
+	if (!D->Defined || !GetBytes(R, R->Message, D->Size))
+		return 0;
+
+	for (i = 0; i < D->NumFields; p += D->Fields[i].Size, i++) {
+		int Num = D->Fields[i].Num;
+		int Size = D->Fields[i].Size;
+		uint32_t Value;
+
+		if (Size != 1 && Size != 2 && Size != 4)
+			continue;
+		Value = GetValue(p, Size, D->BigEndian);
+
+		if (Num == FIELD_TIMESTAMP && Size == 4) {
+			if (Value != 0xFFFFFFFF) {
+				R->Timestamp = Value;
+				R->HaveTimestamp = 1;
+			}
+		} else if (D->Global == MESG_RECORD) {
+			if (Num == RECORD_LAT && Size == 4)
+				Lat = Value;
+			else if (Num == RECORD_LONG && Size == 4)
+				Long = Value;
+			else if (Num == RECORD_ENHANCED_ALTITUDE && Size == 4)
+				Altitude = Value;
+			else if (Num == RECORD_ALTITUDE && Size == 2 &&
+					Value != 0xFFFF && Altitude == 0xFFFFFFFF)
+				Altitude = Value;
+		} else if (D->Global == MESG_EVENT) {
+			if (Num == EVENT_EVENT && Size == 1)
+				Event = Value;
+			else if (Num == EVENT_TYPE && Size == 1)
+				EventType = Value;
+		}
+	}
+
+	if (D->Global == MESG_EVENT && Event == EVENT_TIMER &&
+	    (EventType == EVENT_TYPE_STOP || EventType == EVENT_TYPE_STOP_ALL ||
+	     EventType == EVENT_TYPE_STOP_DISABLE || EventType == EVENT_TYPE_STOP_DISABLE_ALL))
+		EndTrackSegment(&R->Points);
+
+	/* Records without a position, such as from indoor activities, or
+	 * with no time to go by, are no use to us. */
+	if (D->Global != MESG_RECORD || !R->HaveTimestamp ||
+	    Lat == 0x7FFFFFFF || Long == 0x7FFFFFFF)
+		return 1;
+
+	Point.Lat = (int32_t) Lat * SEMICIRCLE;
+	Point.LatDecimals = POSITION_DECIMALS;
+	Point.Long = (int32_t) Long * SEMICIRCLE;
+	Point.LongDecimals = POSITION_DECIMALS;
+	if (Altitude != 0xFFFFFFFF) {
+		Point.Elev = Altitude / 5.0 - 500.0;
+		Point.ElevDecimals = ALTITUDE_DECIMALS;
+	} else {
+		Point.Elev = 0;
+		Point.ElevDecimals = -1;
+	}
+	Point.Time = (time_t) (R->Timestamp + FIT_EPOCH);
+
+	if (!AddTrackPoint(&R->Points, &Point)) {
+		fprintf(stderr, _("Out of memory.\n"));
+		abort();
+	}
+	return 1;
+}
+
+/* Reads one FIT file, which may be one of several in a row. Returns 1
+ * on success, 0 on error, or -1 if there are no more files. */
+static int ReadOneFile(struct FitReader* R)
+{
+	unsigned char Header[255];
+	unsigned char Trailer[2];
+	uint32_t DataSize;
+	unsigned Crc;
+
+	R->Crc = 0;
+	if (!GetBytes(R, Header, 1))
+		return R->Error ? 0 : -1;
+	if (Header[0] < 12 || !GetBytes(R, Header + 1, Header[0] - 1) ||
+	    memcmp(Header + 8, ".FIT", 4) != 0)
+		return 0;
+	DataSize = GetValue(Header + 4, 4, 0);
+
+	/* Local message types only last until the end of the file */
+	memset(R->Defs, 0, sizeof(R->Defs));
+	R->Count = 0;
+	while (R->Count < DataSize) {
+		unsigned char RecordHeader;
+		int Ok;
+
+		if (!GetBytes(R, &RecordHeader, 1))
+			return 0;
+		if (RecordHeader & 0x80) {
+			/* A compressed timestamp header holds just the low 5
+			 * bits of the time, which can only go forward. */
+			uint32_t Offset = RecordHeader & 0x1F;
+			if (R->HaveTimestamp) {
+				if (Offset < (R->Timestamp & 0x1F))
+					R->Timestamp += 0x20;
+				R->Timestamp = (R->Timestamp & ~(uint32_t) 0x1F) | Offset;
+			}
+			Ok = ReadData(R, (RecordHeader >> 5) & 3);
+		} else if (RecordHeader & 0x40) {
+			Ok = ReadDefinition(R, RecordHeader & 0x0F, RecordHeader & 0x20);
+		} else {
+			Ok = ReadData(R, RecordHeader & 0x0F);
+		}
+		if (!Ok)
+			return 0;
+	}
+
+	Crc = R->Crc;
+	if (R->Count != DataSize || !GetBytes(R, Trailer, sizeof(Trailer)) ||
+	    GetValue(Trailer, 2, 0) != Crc)
+		return 0;
+	return 1;
+}
+
+int ReadFIT(const char* File, struct GPSTrack* Track)
+{
+	struct FitReader* R;
+	int Ok;
+
+	R = (struct FitReader*) calloc(1, sizeof(*R));
+	if (R == NULL || (R->In = OpenDecompressed(File)) == NULL) {
+		TrackReadError(_("Failed to read FIT data from %s.\n"), File);
+		free(R);
+		return 0;
+	}
+
+	while ((Ok = ReadOneFile(R)) > 0)
+		;
+	CloseCompressed(R->In);
+
+	if (Ok == 0) {
+		/* Errors while decompressing have been reported already */
+		if (!R->Error)
+			TrackReadError(_("Failed to read FIT data from %s.\n"), File);
+		FreeTrack(&R->Points);
+		free(R);
+		return 0;
+	}
+
+	EndTrackSegment(&R->Points);
+	*Track = R->Points;
+	GetTrackRange(Track);
+	free(R);
+	return 1;
+}
@@ -0,0 +1,601 @@
+/* gpmf-read.c
+ * This file contains routines for reading the track from the GPMF
+ * telemetry that GoPro cameras record in a metadata track of their MP4
+ * files.
+ *
+ * Only the boxes on the way to the sample tables of that track are read,
+ * and then only its samples, so none of the video, which is almost all
+ * of the file, is read at all. Each sample holds about a second of GPS5
+ * readings, at up to 18 Hz, along with the UTC time they start at (GPSU)
+ * and whether the receiver had a fix (GPSF). As the times of points only
+ * go to the second, just the first reading in each second is kept.
+ */
+
+/* Copyright 2026 the gpscorrelate authors.
+ *
+ * This file is part of gpscorrelate.
+ *
+ * gpscorrelate is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * gpscorrelate is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with gpscorrelate; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* Video files are often bigger than 2 GB */
+#define _FILE_OFFSET_BITS 64
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <sys/types.h>
+
+#include "i18n.h"
+#include "gpmf-read.h"
+#include "track-load.h"
+#include "unixtime.h"
+#include "gpsstructure.h"
+
+#define FOURCC(a, b, c, d) ((uint32_t) (a) << 24 | (uint32_t) (b) << 16 | \
+		(uint32_t) (c) << 8 | (uint32_t) (d))
+
+/* Biggest box or sample that will be read into memory, in case the file
+ * is broken. A GPMF sample is a few kB. */
+#define MAX_READ (64 * 1024 * 1024)
+
+/* Most samples in the GPMF track. There's one a second, so this is well
+ * over a week of video. */
+#define MAX_SAMPLES (1024 * 1024)
+
+/* Deepest nesting of GPMF data. GPS5 is in a STRM in a DEVC. */
+#define MAX_NESTING 8
+
+/* Values of GPSF */
+#define FIX_UNKNOWN -1
+#define FIX_2D 2
+
+/* A GPS5 reading is latitude, longitude, altitude, 2D speed and 3D speed */
+#define GPS5_SIZE 20
+#define GPS5_ELEMENTS 5
+
+struct Box {
+	uint32_t Type;
+	off_t Start;		/* Of the contents, after the header */
+	off_t End;
+};
+
+struct Sample {
+	off_t Offset;
+	uint32_t Size;
+	double Duration;	/* In seconds */
+};
+
+struct GPMFReader {
+	FILE* File;
+
+	/* From the latest SCAL, GPSU and GPSF in the current stream */
+	double Scale[GPS5_ELEMENTS];
+	int ScaleDecimals[GPS5_ELEMENTS];
+	int HaveTime;
+	long long TimeMs;	/* Since 1970 */
+	long Fix;
+
+	struct GPSTrack Points;
+};
+
+static uint32_t Get16(const unsigned char* p)
+{
+	return (uint32_t) p[0] << 8 | p[1];
+}
+
+static uint32_t Get32(const unsigned char* p)
+{
+	return (uint32_t) p[0] << 24 | (uint32_t) p[1] << 16 | (uint32_t) p[2] << 8 | p[3];
+}
+
+static uint64_t Get64(const unsigned char* p)
+{
+	return (uint64_t) Get32(p) << 32 | Get32(p + 4);
+}
+
+int IsMP4(const char* Start, size_t Len)
+{
+	return Len >= 12 && memcmp(Start + 4, "ftyp", 4) == 0;
+}
+
+/* Reads the header of the box at *Pos, if there's one before the end of
+ * the Parent box, and moves *Pos on to the box after it. */
+static int NextBox(struct GPMFReader* R, const struct Box* Parent, off_t* Pos,
+		struct Box* Child)
+{
+	unsigned char Header[16];
+	uint64_t Size;
+	off_t HeaderLen = 8;
+
+	if (Parent->End - *Pos < 8 || fseeko(R->File, *Pos, SEEK_SET) != 0 ||
+	    fread(Header, 1, 8, R->File) != 8)
+		return 0;
+	Size = Get32(Header);
+	Child->Type = Get32(Header + 4);
+	if (Size == 1) {
+		/* The size doesn't fit in 32 bits */
+		if (Parent->End - *Pos < 16 || fread(Header + 8, 1, 8, R->File) != 8)
+			return 0;
+		Size = Get64(Header + 8);
+		HeaderLen = 16;
+	} else if (Size == 0) {
+		/* The box goes on to the end */
+		Size = (uint64_t) (Parent->End - *Pos);
+	}
+	if (Size < (uint64_t) HeaderLen || Size > (uint64_t) (Parent->End - *Pos))
+		return 0;
+
+	Child->Start = *Pos + HeaderLen;
+	Child->End = *Pos + (off_t) Size;
+	*Pos = Child->End;
+	return 1;
+}
+
+/* Finds the first box of the given type in the Parent box. */
+static int FindBox(struct GPMFReader* R, const struct Box* Parent, uint32_t Type,
+		struct Box* Child)
+{
+	off_t Pos = Parent->Start;
+
+	while (NextBox(R, Parent, &Pos, Child))
+		if (Child->Type == Type)
+			return 1;
+	return 0;
+}
+
+/* Reads the contents of a box into memory, which must be freed. At least
+ * MinLen bytes are needed. */
+static unsigned char* ReadBox(struct GPMFReader* R, const struct Box* B,
+		size_t MinLen, size_t* Len)
+{
+	unsigned char* Contents;
+
+	if (B->End - B->Start > MAX_READ || (size_t) (B->End - B->Start) < MinLen)
+		return NULL;
+	*Len = (size_t) (B->End - B->Start);
+	Contents = (unsigned char*) malloc(*Len ? *Len : 1);
+	if (Contents == NULL || fseeko(R->File, B->Start, SEEK_SET) != 0 ||
+	    fread(Contents, 1, *Len, R->File) != *Len) {
+		free(Contents);
+		return NULL;
+	}
+	return Contents;
+}
+
+/* Finds the sample table box of the track, if it's a GPMF track, and
+ * the time scale its durations are in. */
+static int IsGPMFTrack(struct GPMFReader* R, const struct Box* Track,
+		struct Box* Stbl, uint32_t* TimeScale)
+{
+	struct Box Mdia, Hdlr, Mdhd, Minf, Stsd;
+	unsigned char* Contents;
+	size_t Len;
+	int Ok;
+
+	if (!FindBox(R, Track, FOURCC('m','d','i','a'), &Mdia) ||
+	    !FindBox(R, &Mdia, FOURCC('h','d','l','r'), &Hdlr))
+		return 0;
+	/* The handler type comes after the version, flags and a zero */
+	Contents = ReadBox(R, &Hdlr, 12, &Len);
+	Ok = Contents && Get32(Contents + 8) == FOURCC('m','e','t','a');
+	free(Contents);
+	if (!Ok)
+		return 0;
+
+	if (!FindBox(R, &Mdia, FOURCC('m','d','h','d'), &Mdhd))
+		return 0;
+	/* The times before the time scale are 64 bits in version 1 */
+	Contents = ReadBox(R, &Mdhd, 24, &Len);
+	if (Contents == NULL)
+		return 0;
+	*TimeScale = Get32(Contents + (Contents[0] == 1 ? 20 : 12));
+	free(Contents);
+
+	if (!FindBox(R, &Mdia, FOURCC('m','i','n','f'), &Minf) ||
+	    !FindBox(R, &Minf, FOURCC('s','t','b','l'), Stbl) ||
+	    !FindBox(R, Stbl, FOURCC('s','t','s','d'), &Stsd))
+		return 0;
+	/* The format of the first sample description */
+	Contents = ReadBox(R, &Stsd, 16, &Len);
+	Ok = Contents && Get32(Contents + 12) == FOURCC('g','p','m','d');
+	free(Contents);
+	return Ok;
+}
+
+/* Reads a table from a full box: the version and flags, a count, then the
+ * entries. Returns the number of entries, or -1 if the box isn't there
+ * or is too short. */
+static long ReadTable(struct GPMFReader* R, const struct Box* Stbl, uint32_t Type,
+		size_t Skip, size_t EntrySize, unsigned char** Contents)
+{
+	struct Box B;
+	size_t Len;
+	uint32_t Count;
+
+	*Contents = NULL;
+	if (!FindBox(R, Stbl, Type, &B) ||
+	    (*Contents = ReadBox(R, &B, 8 + Skip, &Len)) == NULL)
+		return -1;
+	Count = Get32(*Contents + 4 + Skip);
+	if ((Len - 8 - Skip) / EntrySize < Count) {
+		free(*Contents);
+		*Contents = NULL;
+		return -1;
+	}
+	return (long) Count;
+}
+
+/* Works out where each sample is in the file, and how long it lasts,
+ * from the sample tables. Returns the number of samples, or -1 if the
+ * tables can't be read. */
+static long ReadSampleTables(struct GPMFReader* R, const struct Box* Stbl,
+		uint32_t TimeScale, struct Sample** Samples)
+{
+	struct Box Stsz;
+	unsigned char* Sizes = NULL;
+	unsigned char* Stsc = NULL;
+	unsigned char* Stco = NULL;
+	unsigned char* Stts = NULL;
+	long NumSamples, NumStsc, NumChunks, NumStts;
+	uint32_t FixedSize;
+	size_t Len;
+	int Large = 0;
+	long Sample, i;
+
+	*Samples = NULL;
+	NumStsc = ReadTable(R, Stbl, FOURCC('s','t','s','c'), 0, 12, &Stsc);
+	NumStts = ReadTable(R, Stbl, FOURCC('s','t','t','s'), 0, 8, &Stts);
+	NumChunks = ReadTable(R, Stbl, FOURCC('s','t','c','o'), 0, 4, &Stco);
+	if (NumChunks < 0) {
+		NumChunks = ReadTable(R, Stbl, FOURCC('c','o','6','4'), 0, 8, &Stco);
+		Large = 1;
+	}
+	/* Either every sample has the same size, or the sizes are listed */
+	NumSamples = -1;
+	FixedSize = 0;
+	if (FindBox(R, Stbl, FOURCC('s','t','s','z'), &Stsz) &&
+	    (Sizes = ReadBox(R, &Stsz, 12, &Len)) != NULL) {
+		FixedSize = Get32(Sizes + 4);
+		NumSamples = (long) Get32(Sizes + 8);
+		if ((FixedSize == 0 && (Len - 12) / 4 < (size_t) NumSamples) ||
+		    NumSamples > MAX_SAMPLES)
+			NumSamples = -1;
+	}
+
+	if (NumStsc < 0 || NumStts < 0 || NumChunks < 0 || NumSamples < 0 ||
+	    (*Samples = (struct Sample*) calloc(NumSamples + 1, sizeof(struct Sample))) == NULL) {
+		NumSamples = -1;
+		goto Done;
+	}
+
+	/* Runs of chunks with the same number of samples in each */
+	Sample = 0;
+	for (i = 0; i < NumStsc && Sample < NumSamples; i++) {
+		uint32_t FirstChunk = Get32(Stsc + 8 + i * 12);
+		uint32_t PerChunk = Get32(Stsc + 8 + i * 12 + 4);
+		uint32_t NextChunk = i + 1 < NumStsc ?
+			Get32(Stsc + 8 + (i + 1) * 12) : (uint32_t) NumChunks + 1;
+		uint32_t Chunk;
+
+		for (Chunk = FirstChunk; Chunk >= 1 && Chunk < NextChunk &&
+				Chunk <= (uint32_t) NumChunks && Sample < NumSamples; Chunk++) {
+			off_t Offset = Large ? (off_t) Get64(Stco + 8 + (Chunk - 1) * 8) :
+				(off_t) Get32(Stco + 8 + (Chunk - 1) * 4);
+			uint32_t k;
+
+			for (k = 0; k < PerChunk && Sample < NumSamples; k++, Sample++) {
+				uint32_t Size = FixedSize ? FixedSize : Get32(Sizes + 12 + Sample * 4);
+				(*Samples)[Sample].Offset = Offset;
+				(*Samples)[Sample].Size = Size;
+				Offset += Size;
+			}
+		}
+	}
+	NumSamples = Sample;
+
+	/* Runs of samples with the same duration */
+	Sample = 0;
+	for (i = 0; i < NumStts && Sample < NumSamples; i++) {
+		uint32_t Count = Get32(Stts + 8 + i * 8);
+		double Duration = (double) Get32(Stts + 8 + i * 8 + 4) / (TimeScale ? TimeScale : 1);
+		uint32_t k;
+
+		for (k = 0; k < Count && Sample < NumSamples; k++, Sample++)
+			(*Samples)[Sample].Duration = Duration;
+	}
+
+Done:
+	free(Sizes);
+	free(Stsc);
+	free(Stco);
+	free(Stts);
+	return NumSamples;
+}
+
+/* Forgets what's known about the current stream, as a new one begins. */
+static void StartStream(struct GPMFReader* R)
+{
+	int i;
+
+	for (i = 0; i < GPS5_ELEMENTS; i++) {
+		R->Scale[i] = 1.0;
+		R->ScaleDecimals[i] = 0;
+	}
+	R->HaveTime = 0;
+	R->Fix = FIX_UNKNOWN;
+}
+
+/* Reads an integer of the given GPMF type. Returns 0 for any other type. */
+static int GetInteger(char Type, const unsigned char* p, long* Value)
+{
+	switch (Type) {
+	case 'b': *Value = (signed char) p[0]; return 1;
+	case 'B': *Value = p[0]; return 1;
+	case 's': *Value = (int16_t) Get16(p); return 1;
+	case 'S': *Value = (long) Get16(p); return 1;
+	case 'l': *Value = (int32_t) Get32(p); return 1;
+	case 'L': *Value = (long) Get32(p); return 1;
+	}
+	return 0;
+}
+
+static size_t TypeSize(char Type)
+{
+	switch (Type) {
+	case 'b': case 'B': return 1;
+	case 's': case 'S': return 2;
+	case 'l': case 'L': return 4;
+	}
+	return 0;
+}
+
+/* SCAL gives what to divide each element of the readings by, or a
+ * single divisor for all of them. */
+static void ReadScale(struct GPMFReader* R, char Type, const unsigned char* Data,
+		size_t Len)
+{
+	size_t Size = TypeSize(Type);
+	size_t Count;
+	size_t i;
+
+	if (Size == 0 || Len < Size)
+		return;
+	Count = Len / Size;
+	for (i = 0; i < GPS5_ELEMENTS; i++) {
+		long Value;
+		long Power;
+
+		if (!GetInteger(Type, Data + (i < Count ? i : 0) * Size, &Value))
+			return;
+		if (Value <= 0)
+			Value = 1;
+		R->Scale[i] = (double) Value;
+		/* Scales are powers of ten, so this is the number of decimals */
+		R->ScaleDecimals[i] = 0;
+		for (Power = 10; Power <= Value; Power *= 10)
+			R->ScaleDecimals[i]++;
+	}
+}
+
+/* GPSU is the UTC time of the first reading, as yymmddhhmmss.sss */
+static void ReadTime(struct GPMFReader* R, const unsigned char* Data, size_t Len)
+{
+	long Field[6];
+	long Ms = 0;
+	int i;
+
+	R->HaveTime = 0;
+	if (Len < 12)
+		return;
+	for (i = 0; i < 12; i++)
+		if (Data[i] < '0' || Data[i] > '9')
+			return;
+	for (i = 0; i < 6; i++)
+		Field[i] = (Data[i * 2] - '0') * 10 + (Data[i * 2 + 1] - '0');
+	if (Len >= 16 && Data[12] == '.') {
+		for (i = 13; i < 16 && Data[i] >= '0' && Data[i] <= '9'; i++)
+			Ms = Ms * 10 + (Data[i] - '0');
+		for (; i < 16; i++)
+			Ms *= 10;
+	}
+	if (Field[1] < 1 || Field[1] > 12)
+		return;
+
+	R->TimeMs = (long long) UTCToUnixTime(2000 + Field[0], (int) Field[1], Field[2],
+		Field[3], Field[4], Field[5]) * 1000 + Ms;
+	R->HaveTime = 1;
+}
+
+/* Adds the GPS5 readings of one sample, which are spread evenly over the
+ * Duration of the sample. */
+static void AddReadings(struct GPMFReader* R, const unsigned char* Data,
+		size_t Count, double Duration)
+{
+	size_t i;
+
+	if (R->Fix != FIX_UNKNOWN && R->Fix < FIX_2D) {
+		EndTrackSegment(&R->Points);
+		return;
+	}
+	if (!R->HaveTime)
+		return;
+
+	for (i = 0; i < Count; i++, Data += GPS5_SIZE) {
+		long long Ms = R->TimeMs + (long long) (Duration * 1000.0 * i / Count);
+		time_t Time = (time_t) (Ms / 1000);
+		int32_t Lat = (int32_t) Get32(Data);
+		int32_t Long = (int32_t) Get32(Data + 4);
+		size_t Last = R->Points.NumPoints;
+		struct GPSPoint Point;
+
+		/* Only the first reading of each second is needed */
+		if (Last && Time <= R->Points.Time[Last - 1])
+			continue;
+		/* Some cameras write zeros until they get a fix */
+		if (Lat == 0 && Long == 0)
+			continue;
+
+		Point.Lat = Lat / R->Scale[0];
+		Point.LatDecimals = R->ScaleDecimals[0];
+		Point.Long = Long / R->Scale[1];
+		Point.LongDecimals = R->ScaleDecimals[1];
+		/* A 2D fix has no altitude to speak of */
+		if (R->Fix != FIX_2D) {
+			Point.Elev = (int32_t) Get32(Data + 8) / R->Scale[2];
+			Point.ElevDecimals = R->ScaleDecimals[2];
+		} else {
+			Point.Elev = 0;
+			Point.ElevDecimals = -1;
+		}
+		Point.Time = Time;
+
+		if (!AddTrackPoint(&R->Points, &Point)) {
+			fprintf(stderr, _("Out of memory.\n"));
+			abort();
+		}
+	}
+}
+
+/* Reads the GPMF key-length-value entries of a sample. */
+static void ReadKLV(struct GPMFReader* R, const unsigned char* p, size_t Len,
+		double Duration, int Depth)
+{
+	while (Len >= 8) {
+		uint32_t Key = Get32(p);
+		char Type = (char) p[4];
+		size_t StructSize = p[5];
+		size_t Repeat = Get16(p + 6);
+		size_t DataLen = StructSize * Repeat;
+		/* Each entry is padded to a multiple of 4 bytes */
+		size_t Padded = (DataLen + 3) & ~(size_t) 3;
+		const unsigned char* Data = p + 8;
+		long Value;
+
+		if (Key == 0 || Padded > Len - 8)
+			break;
+
+		if (Type == 0) {
+			if (Key == FOURCC('S','T','R','M'))
+				StartStream(R);
+			if (Depth < MAX_NESTING)
+				ReadKLV(R, Data, DataLen, Duration, Depth + 1);
+		} else if (Key == FOURCC('S','C','A','L')) {
+			ReadScale(R, Type, Data, DataLen);
+		} else if (Key == FOURCC('G','P','S','U')) {
+			ReadTime(R, Data, DataLen);
+		} else if (Key == FOURCC('G','P','S','F') && DataLen >= TypeSize(Type) &&
+				GetInteger(Type, Data, &Value)) {
+			R->Fix = Value;
+		} else if (Key == FOURCC('G','P','S','5') && Type == 'l' && StructSize == GPS5_SIZE) {
+			AddReadings(R, Data, Repeat, Duration);
+		}
+
+		p += 8 + Padded;
+		Len -= 8 + Padded;
+	}
+}
+
+/* Reads the GPMF track, whose sample tables are in Stbl. */
+static int ReadTrack(struct GPMFReader* R, const struct Box* Stbl, uint32_t TimeScale)
+{
+	struct Sample* Samples;
+	unsigned char* Buffer = NULL;
+	size_t BufferSize = 0;
+	long NumSamples;
+	long i;
+	int Ok = 1;
+
+	NumSamples = ReadSampleTables(R, Stbl, TimeScale, &Samples);
+	if (NumSamples < 0)
+		return 0;
+
+	for (i = 0; i < NumSamples; i++) {
+		const struct Sample* S = &Samples[i];
+
+		if (S->Size > MAX_READ) {
+			Ok = 0;
+			break;
+		}
+		if (S->Size > BufferSize) {
+			unsigned char* Bigger = (unsigned char*) realloc(Buffer, S->Size);
+			if (Bigger == NULL) {
+				Ok = 0;
+				break;
+			}
+			Buffer = Bigger;
+			BufferSize = S->Size;
+		}
+		if (fseeko(R->File, S->Offset, SEEK_SET) != 0 ||
+		    fread(Buffer, 1, S->Size, R->File) != S->Size) {
+			Ok = 0;
+			break;
+		}
+
+		StartStream(R);
+		ReadKLV(R, Buffer, S->Size, S->Duration, 0);
+	}
+
+	free(Buffer);
+	free(Samples);
+	return Ok;
+}
+
+int ReadGPMF(const char* File, struct GPSTrack* Track)
+{
+	struct GPMFReader R;
+	struct Box Whole, Moov, Trak, Stbl;
+	uint32_t TimeScale;
+	off_t Pos;
+	int Found = 0;
+	int Ok = 0;
+
+	memset(&R, 0, sizeof(R));
+	R.File = fopen(File, "rb");
+	if (R.File == NULL || fseeko(R.File, 0, SEEK_END) != 0) {
+		TrackReadError(_("Failed to read GoPro GPS data from %s.\n"), File);
+		if (R.File)
+			fclose(R.File);
+		return 0;
+	}
+	Whole.Type = 0;
+	Whole.Start = 0;
+	Whole.End = ftello(R.File);
+
+	if (FindBox(&R, &Whole, FOURCC('m','o','o','v'), &Moov)) {
+		Pos = Moov.Start;
+		while (!Found && NextBox(&R, &Moov, &Pos, &Trak)) {
+			if (Trak.Type == FOURCC('t','r','a','k') &&
+			    IsGPMFTrack(&R, &Trak, &Stbl, &TimeScale)) {
+				Found = 1;
+				Ok = ReadTrack(&R, &Stbl, TimeScale);
+			}
+		}
+	}
+	fclose(R.File);
+
+	if (!Ok) {
+		TrackReadError(_("Failed to read GoPro GPS data from %s.\n"), File);
+		FreeTrack(&R.Points);
+		return 0;
+	}
+
+	EndTrackSegment(&R.Points);
+	*Track = R.Points;
+	GetTrackRange(Track);
+	return 1;
+}
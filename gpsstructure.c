@@ -0,0 +1,469 @@
+/* gpsstructure.c
+ * This file contains routines for building up tracks of GPS points
+ * and getting the points back out of them.
+ */
+
+/* Copyright 2026 the gpscorrelate authors.
+ *
+ * This file is part of gpscorrelate.
+ *
+ * gpscorrelate is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * gpscorrelate is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with gpscorrelate; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <math.h>
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
+
+#include "gpsstructure.h"
+
+/* Room for this many points is made when a track is started */
+#define MIN_POINTS 64
+
+/* Bytes per point in all the arrays, bar the bitmap */
+#define POINT_BYTES (sizeof(time_t) + 3 * sizeof(double) + 3)
+
+/* Rounds a size up so that the array after it is suitably aligned */
+#define ALIGN(n) (((n) + 7) & ~(size_t) 7)
+
+/* What a compact track keeps, in units of a degree and a metre */
+#define LATLONG_SCALE 1e7
+#define LATLONG_DECIMALS 7
+#define ELEV_SCALE 10.0
+#define ELEV_DECIMALS 1
+
+/* How the numbers of decimal places are packed into a byte in a compact
+ * track. The elevation has 0 or 1, or NO_ELEV if there isn't one. */
+#define PACK_DECIMALS(Lat, Long, Elev) \
+	((unsigned char) ((Lat) | ((Long) << 3) | ((Elev) << 6)))
+#define LAT_DECIMALS(Packed) ((Packed) & 7)
+#define LONG_DECIMALS(Packed) (((Packed) >> 3) & 7)
+#define ELEV_DECIMALS_OF(Packed) ((Packed) >> 6)
+#define NO_ELEV 2
+
+/* Where each array goes in a block with room for Max points */
+struct BlockLayout {
+	size_t Lat, Long, Elev;
+	size_t LatDecimals, LongDecimals, ElevDecimals;
+	size_t SegmentEnd;
+	size_t Size;
+};
+
+/* Works out the layout of a block, larger types first. Returns 0 if it
+ * would be too big. */
+static int GetLayout(size_t Max, struct BlockLayout* L)
+{
+	if (Max > ((size_t) -1 - 64) / (POINT_BYTES + 1))
+		return 0;
+	L->Lat = ALIGN(Max * sizeof(time_t));
+	L->Long = L->Lat + Max * sizeof(double);
+	L->Elev = L->Long + Max * sizeof(double);
+	L->LatDecimals = L->Elev + Max * sizeof(double);
+	L->LongDecimals = L->LatDecimals + Max;
+	L->ElevDecimals = L->LongDecimals + Max;
+	L->SegmentEnd = L->ElevDecimals + Max;
+	L->Size = L->SegmentEnd + (Max + 7) / 8;
+	return 1;
+}
+
+/* Packs a number of decimal places into a byte. None of them ever need
+ * anywhere near that many, and any negative number means there aren't
+ * any at all. */
+static signed char PackDecimals(int Decimals)
+{
+	if (Decimals > SCHAR_MAX)
+		return SCHAR_MAX;
+	if (Decimals < 0)
+		return -1;
+	return (signed char) Decimals;
+}
+
+/* Lets go of the block holding a track's arrays. */
+static void FreeBlock(struct GPSTrack* Track)
+{
+#ifndef _WIN32
+	if (Track->Mapped) {
+		munmap(Track->Block, Track->BlockSize);
+		Track->Mapped = 0;
+		return;
+	}
+#endif
+	free(Track->Block);
+}
+
+int ReserveTrack(struct GPSTrack* Track, size_t NumPoints)
+{
+	struct BlockLayout L;
+	size_t N = Track->NumPoints;
+	size_t Max;
+	char* Block;
+
+	if (NumPoints <= Track->MaxPoints)
+		return 1;
+	if (Track->Compact)
+		return 0;
+	Max = Track->MaxPoints ? Track->MaxPoints : MIN_POINTS;
+	while (Max < NumPoints)
+		Max = Max > (size_t) -1 / 2 ? NumPoints : Max * 2;
+
+	if (!GetLayout(Max, &L))
+		return 0;
+	Block = (char*) malloc(L.Size);
+	if (Block == NULL)
+		return 0;
+
+	/* Move the points over to the new block */
+	if (N > 0) {
+		memcpy(Block, Track->Time, N * sizeof(time_t));
+		memcpy(Block + L.Lat, Track->Lat, N * sizeof(double));
+		memcpy(Block + L.Long, Track->Long, N * sizeof(double));
+		memcpy(Block + L.Elev, Track->Elev, N * sizeof(double));
+		memcpy(Block + L.LatDecimals, Track->LatDecimals, N);
+		memcpy(Block + L.LongDecimals, Track->LongDecimals, N);
+		memcpy(Block + L.ElevDecimals, Track->ElevDecimals, N);
+		memcpy(Block + L.SegmentEnd, Track->SegmentEnd, (N + 7) / 8);
+	}
+	memset(Block + L.SegmentEnd + (N + 7) / 8, 0, (Max + 7) / 8 - (N + 7) / 8);
+	FreeBlock(Track);
+
+	Track->Time = (time_t*) (void*) Block;
+	Track->Lat = (double*) (void*) (Block + L.Lat);
+	Track->Long = (double*) (void*) (Block + L.Long);
+	Track->Elev = (double*) (void*) (Block + L.Elev);
+	Track->LatDecimals = (signed char*) (Block + L.LatDecimals);
+	Track->LongDecimals = (signed char*) (Block + L.LongDecimals);
+	Track->ElevDecimals = (signed char*) (Block + L.ElevDecimals);
+	Track->SegmentEnd = (unsigned char*) (Block + L.SegmentEnd);
+	Track->Block = Block;
+	Track->BlockSize = L.Size;
+	Track->NumBlocks++;
+	Track->MaxPoints = Max;
+	return 1;
+}
+
+int AddTrackPoint(struct GPSTrack* Track, const struct GPSPoint* Point)
+{
+	size_t i = Track->NumPoints;
+
+	if (i == Track->MaxPoints && !ReserveTrack(Track, i + 1))
+		return 0;
+
+	Track->Time[i] = Point->Time;
+	Track->Lat[i] = Point->Lat;
+	Track->Long[i] = Point->Long;
+	Track->Elev[i] = Point->Elev;
+	Track->LatDecimals[i] = PackDecimals(Point->LatDecimals);
+	Track->LongDecimals[i] = PackDecimals(Point->LongDecimals);
+	Track->ElevDecimals[i] = PackDecimals(Point->ElevDecimals);
+	Track->NumPoints++;
+	Track->InOrder = 0;
+	return 1;
+}
+
+void EndTrackSegment(struct GPSTrack* Track)
+{
+	size_t i = Track->NumPoints;
+
+	if (i > 0) {
+		i--;
+		Track->SegmentEnd[i / 8] |= (unsigned char) (1 << (i % 8));
+	}
+}
+
+int AppendTrack(struct GPSTrack* Track, struct GPSTrack* Other, int EndBefore)
+{
+	size_t Start = Track->NumPoints;
+	size_t N = Other->NumPoints;
+	size_t i;
+
+	if (Track->Compact || Other->Compact)
+		return 0;
+	if (EndBefore)
+		EndTrackSegment(Track);
+	if (N == 0) {
+		FreeTrack(Other);
+		return 1;
+	}
+	if (!ReserveTrack(Track, Start + N))
+		return 0;
+
+	memcpy(Track->Time + Start, Other->Time, N * sizeof(*Track->Time));
+	memcpy(Track->Lat + Start, Other->Lat, N * sizeof(*Track->Lat));
+	memcpy(Track->Long + Start, Other->Long, N * sizeof(*Track->Long));
+	memcpy(Track->Elev + Start, Other->Elev, N * sizeof(*Track->Elev));
+	memcpy(Track->LatDecimals + Start, Other->LatDecimals, N);
+	memcpy(Track->LongDecimals + Start, Other->LongDecimals, N);
+	memcpy(Track->ElevDecimals + Start, Other->ElevDecimals, N);
+	Track->NumPoints = Start + N;
+	Track->InOrder = 0;
+	for (i = 0; i < N; i++)
+		if (IS_SEGMENT_END(Other, i))
+			Track->SegmentEnd[(Start + i) / 8] |=
+				(unsigned char) (1 << ((Start + i) % 8));
+
+	FreeTrack(Other);
+	return 1;
+}
+
+void GetTrackPoint(const struct GPSTrack* Track, size_t i, struct GPSPoint* Point)
+{
+	if (Track->Compact) {
+		unsigned Decimals = Track->CompactDecimals[i];
+
+		Point->Lat = Track->CompactLat[i] / LATLONG_SCALE;
+		Point->LatDecimals = LAT_DECIMALS(Decimals);
+		Point->Long = Track->CompactLong[i] / LATLONG_SCALE;
+		Point->LongDecimals = LONG_DECIMALS(Decimals);
+		if (ELEV_DECIMALS_OF(Decimals) == NO_ELEV) {
+			Point->Elev = 0;
+			Point->ElevDecimals = -1;
+		} else {
+			Point->Elev = Track->CompactElev[i] / ELEV_SCALE;
+			Point->ElevDecimals = ELEV_DECIMALS_OF(Decimals);
+		}
+		Point->Time = GetTrackTime(Track, i);
+		return;
+	}
+
+	Point->Lat = Track->Lat[i];
+	Point->LatDecimals = Track->LatDecimals[i];
+	Point->Long = Track->Long[i];
+	Point->LongDecimals = Track->LongDecimals[i];
+	Point->Elev = Track->Elev[i];
+	Point->ElevDecimals = Track->ElevDecimals[i];
+	Point->Time = Track->Time[i];
+}
+
+/* Determines and stores the min and max times from the GPS track */
+void GetTrackRange(struct GPSTrack* Track)
+{
+	size_t i;
+
+	if (Track->NumPoints == 0)
+		return;
+
+	/* The points should be in order of time, but they might not be,
+	 * so go through them all anyway. */
+	Track->MinTime = Track->MaxTime = TRACK_TIME(Track, 0);
+	Track->InOrder = 1;
+	for (i = 1; i < Track->NumPoints; i++)
+	{
+		time_t Time = TRACK_TIME(Track, i);
+		if (Time < Track->MaxTime)
+			Track->InOrder = 0;
+		if (Time < Track->MinTime)
+			Track->MinTime = Time;
+		if (Time > Track->MaxTime)
+			Track->MaxTime = Time;
+	}
+}
+
+size_t FindTrackTime(const struct GPSTrack* Track, size_t First, size_t Past,
+		time_t Time)
+{
+	size_t Low = First;
+	size_t High = Past;
+
+	if (!Track->InOrder) {
+		while (Low < High && TRACK_TIME(Track, Low) < Time)
+			Low++;
+		return Low;
+	}
+
+	/* The answer is always somewhere in [Low, High] */
+	while (Low < High) {
+		size_t Middle = Low + (High - Low) / 2;
+		if (TRACK_TIME(Track, Middle) < Time)
+			Low = Middle + 1;
+		else
+			High = Middle;
+	}
+	return Low;
+}
+
+time_t GetTrackTime(const struct GPSTrack* Track, size_t i)
+{
+	const struct TimeBlock* B = &Track->TimeBlocks[i / TRACK_BLOCK];
+	const unsigned char* Offsets = Track->TimeOffsets + B->Offsets;
+	size_t j = i % TRACK_BLOCK;
+
+	/* Each block's offsets are aligned to their own size */
+	switch (B->Width) {
+	case 1:
+		return (time_t) (B->Base + Offsets[j]);
+	case 2:
+		return (time_t) (B->Base + ((const uint16_t*) (const void*) Offsets)[j]);
+	default:
+		return (time_t) (B->Base + ((const uint32_t*) (const void*) Offsets)[j]);
+	}
+}
+
+/* Turns Value into a whole number of units of 1/Scale, if it fits. */
+static int Quantize(double Value, double Scale, int32_t* Result)
+{
+	double Scaled = floor(Value * Scale + 0.5);
+
+	if (!(Scaled >= INT32_MIN && Scaled <= INT32_MAX))
+		return 0;
+	*Result = (int32_t) Scaled;
+	return 1;
+}
+
+/* Clamps a number of decimal places to what a compact track keeps */
+static int KeepDecimals(int Decimals, int Most)
+{
+	return Decimals < 0 ? 0 : Decimals > Most ? Most : Decimals;
+}
+
+int CompactTrack(struct GPSTrack* Track)
+{
+	size_t N = Track->NumPoints;
+	size_t NumBlocks = (N + TRACK_BLOCK - 1) / TRACK_BLOCK;
+	size_t OffsetBytes = 0;
+	size_t Lat, Long, Elev, Offsets, Decimals, SegmentEnd, Size;
+	struct TimeBlock* Blocks;
+	char* Block;
+	size_t b, i;
+	int32_t Dummy;
+
+	if (Track->Compact || N == 0)
+		return 1;
+
+	/* Make sure every point can be kept before starting */
+	for (i = 0; i < N; i++)
+		if (!Quantize(Track->Lat[i], LATLONG_SCALE, &Dummy) ||
+		    !Quantize(Track->Long[i], LATLONG_SCALE, &Dummy) ||
+		    (Track->ElevDecimals[i] >= 0 &&
+		     !Quantize(Track->Elev[i], ELEV_SCALE, &Dummy)))
+			return 0;
+
+	/* Work out how big each block's offsets need to be */
+	Blocks = (struct TimeBlock*) malloc(NumBlocks * sizeof(*Blocks));
+	if (Blocks == NULL)
+		return 0;
+	for (b = 0; b < NumBlocks; b++) {
+		size_t End = (b + 1) * TRACK_BLOCK < N ? (b + 1) * TRACK_BLOCK : N;
+		int64_t Min = (int64_t) Track->Time[b * TRACK_BLOCK];
+		int64_t Max = Min;
+		uint64_t Span;
+
+		for (i = b * TRACK_BLOCK + 1; i < End; i++) {
+			if ((int64_t) Track->Time[i] < Min)
+				Min = (int64_t) Track->Time[i];
+			if ((int64_t) Track->Time[i] > Max)
+				Max = (int64_t) Track->Time[i];
+		}
+		Span = (uint64_t) Max - (uint64_t) Min;
+		if (Span > UINT32_MAX || OffsetBytes > UINT32_MAX - 4 * TRACK_BLOCK) {
+			free(Blocks);
+			return 0;
+		}
+		Blocks[b].Base = Min;
+		Blocks[b].Width = Span <= UINT8_MAX ? 1 : Span <= UINT16_MAX ? 2 : 4;
+		OffsetBytes = (OffsetBytes + Blocks[b].Width - 1) & ~(size_t) (Blocks[b].Width - 1);
+		Blocks[b].Offsets = (uint32_t) OffsetBytes;
+		OffsetBytes += (End - b * TRACK_BLOCK) * Blocks[b].Width;
+	}
+
+	/* The new block of memory has the larger types first, as before */
+	Lat = ALIGN(NumBlocks * sizeof(*Blocks));
+	Long = Lat + N * sizeof(int32_t);
+	Elev = Long + N * sizeof(int32_t);
+	Offsets = Elev + N * sizeof(int32_t);
+	Decimals = Offsets + OffsetBytes;
+	SegmentEnd = Decimals + N;
+	Size = SegmentEnd + (N + 7) / 8;
+	Block = (char*) malloc(Size);
+	if (Block == NULL) {
+		free(Blocks);
+		return 0;
+	}
+	memcpy(Block, Blocks, NumBlocks * sizeof(*Blocks));
+	free(Blocks);
+	Blocks = (struct TimeBlock*) (void*) Block;
+
+	for (i = 0; i < N; i++) {
+		const struct TimeBlock* B = &Blocks[i / TRACK_BLOCK];
+		unsigned char* To = (unsigned char*) Block + Offsets + B->Offsets;
+		uint32_t Offset = (uint32_t) ((int64_t) Track->Time[i] - B->Base);
+		int ElevDecimals = NO_ELEV;
+		int32_t Value = 0;
+
+		if (B->Width == 1)
+			To[i % TRACK_BLOCK] = (unsigned char) Offset;
+		else if (B->Width == 2)
+			((uint16_t*) (void*) To)[i % TRACK_BLOCK] = (uint16_t) Offset;
+		else
+			((uint32_t*) (void*) To)[i % TRACK_BLOCK] = Offset;
+
+		Quantize(Track->Lat[i], LATLONG_SCALE, &Value);
+		((int32_t*) (void*) (Block + Lat))[i] = Value;
+		Quantize(Track->Long[i], LATLONG_SCALE, &Value);
+		((int32_t*) (void*) (Block + Long))[i] = Value;
+		Value = 0;
+		if (Track->ElevDecimals[i] >= 0) {
+			Quantize(Track->Elev[i], ELEV_SCALE, &Value);
+			ElevDecimals = KeepDecimals(Track->ElevDecimals[i], ELEV_DECIMALS);
+		}
+		((int32_t*) (void*) (Block + Elev))[i] = Value;
+		Block[Decimals + i] = (char) PACK_DECIMALS(
+			KeepDecimals(Track->LatDecimals[i], LATLONG_DECIMALS),
+			KeepDecimals(Track->LongDecimals[i], LATLONG_DECIMALS),
+			ElevDecimals);
+	}
+	memcpy(Block + SegmentEnd, Track->SegmentEnd, (N + 7) / 8);
+	FreeBlock(Track);
+
+	Track->Time = NULL;
+	Track->Lat = Track->Long = Track->Elev = NULL;
+	Track->LatDecimals = Track->LongDecimals = Track->ElevDecimals = NULL;
+	Track->Compact = 1;
+	Track->TimeBlocks = Blocks;
+	Track->TimeOffsets = (unsigned char*) Block + Offsets;
+	Track->CompactLat = (int32_t*) (void*) (Block + Lat);
+	Track->CompactLong = (int32_t*) (void*) (Block + Long);
+	Track->CompactElev = (int32_t*) (void*) (Block + Elev);
+	Track->CompactDecimals = (unsigned char*) Block + Decimals;
+	Track->SegmentEnd = (unsigned char*) Block + SegmentEnd;
+	Track->Block = Block;
+	Track->BlockSize = Size;
+	Track->NumBlocks++;
+	Track->MaxPoints = N;
+	return 1;
+}
+
+void GetTrackStats(const struct GPSTrack* Track, struct TrackStats* Stats)
+{
+	size_t i;
+
+	Stats->Points = Track->NumPoints;
+	Stats->Segments = 0;
+	for (i = 0; i < Track->NumPoints; i++)
+		if (IS_SEGMENT_END(Track, i))
+			Stats->Segments++;
+	Stats->Capacity = Track->MaxPoints;
+	Stats->Bytes = Track->BlockSize;
+	Stats->Allocations = Track->NumBlocks;
+}
+
+void FreeTrack(struct GPSTrack* Track)
+{
+	/* All the points go at once */
+	FreeBlock(Track);
+	memset(Track, 0, sizeof(*Track));
+}
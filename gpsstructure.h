@@ -26,8 +26,16 @@
  * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
  */
 
-/* This data structure describes a single point.
- * The NewGpsPoint() function allocates an initialized one. */
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* This data structure describes a single point, such as the one found
+ * for a photo. The NewGpsPoint() function allocates an initialized one. */
 
 struct GPSPoint {
 	double Lat;
@@ -37,12 +45,128 @@ struct GPSPoint {
 	double Elev;
 	int ElevDecimals;
 	time_t Time;
-	int EndOfSegment;
-	struct GPSPoint* Next;
+};
+
+/* A track keeps its points in a separate array for each field rather than
+ * as one structure per point, so that going through the times (which is
+ * most of the work of matching photos to it) reads nothing else. The
+ * numbers of decimal places are kept in a byte each, and the ends of
+ * the track segments in a bitmap. All the arrays are carved out of the
+ * one block of memory, which is replaced by one twice the size whenever
+ * it fills up, so a track is only ever a single allocation. A track loaded
+ * from its cache (see track-cache.c) uses the cache file mapped into
+ * memory as its block instead, until it needs room for more points.
+ *
+ * Once a track has been read in, CompactTrack can squeeze it into less
+ * than half the space. The latitude and longitude are then kept in
+ * units of 1e-7 degrees and the elevation in decimetres, in 32-bit
+ * integers, and the numbers of decimal places all in one byte. The
+ * times are split into blocks of TRACK_BLOCK points, each with a time
+ * to start from and the offset of each point from it, in as few bytes
+ * as the block needs. */
+
+/* Points in each block of times in a compact track */
+#define TRACK_BLOCK 64
+
+struct TimeBlock {
+	int64_t Base;		/* Earliest time in the block */
+	uint32_t Offsets;	/* Where in TimeOffsets the block's are */
+	uint32_t Width;		/* Bytes in each offset: 1, 2 or 4 */
 };
 
 struct GPSTrack {
-	struct GPSPoint* Points;
+	size_t NumPoints;
+	size_t MaxPoints;	/* Room in the arrays */
+	time_t* Time;
+	double* Lat;
+	double* Long;
+	double* Elev;
+	signed char* LatDecimals;
+	signed char* LongDecimals;
+	signed char* ElevDecimals;	/* Negative if there's no elevation */
+	unsigned char* SegmentEnd;	/* Bit i set if a segment ends at i */
 	time_t MinTime;
 	time_t MaxTime;
+	int InOrder;		/* Set if the times never go backwards */
+
+	/* Used instead of the arrays above, bar SegmentEnd, once compact */
+	int Compact;
+	struct TimeBlock* TimeBlocks;
+	unsigned char* TimeOffsets;
+	int32_t* CompactLat;
+	int32_t* CompactLong;
+	int32_t* CompactElev;
+	unsigned char* CompactDecimals;
+
+	void* Block;		/* Holds all the arrays */
+	size_t BlockSize;
+	size_t NumBlocks;	/* How many have been allocated so far */
+	int Mapped;		/* Set if Block is a cache file mapped in */
+};
+
+/* How much memory a track is using */
+struct TrackStats {
+	size_t Points;
+	size_t Segments;
+	size_t Capacity;	/* Points there's room for */
+	size_t Bytes;		/* Held for the points */
+	size_t Allocations;	/* Blocks allocated over the track's life */
 };
+
+/* Whether point i of a track is the last in its track segment */
+#define IS_SEGMENT_END(Track, i) \
+	(((Track)->SegmentEnd[(i) / 8] >> ((i) % 8)) & 1)
+
+/* The time of point i of a track, whether it's compact or not */
+#define TRACK_TIME(Track, i) \
+	((Track)->Time ? (Track)->Time[i] : GetTrackTime((Track), (i)))
+
+/* Adds a copy of Point to the end of a track. Returns 0 if there's no
+ * memory for it, or if the track is compact. */
+int AddTrackPoint(struct GPSTrack* Track, const struct GPSPoint* Point);
+
+/* Marks the last point of a track as the end of a track segment. */
+void EndTrackSegment(struct GPSTrack* Track);
+
+/* Makes room in a track for NumPoints points in all. Returns 0 if there's
+ * no memory for them. */
+int ReserveTrack(struct GPSTrack* Track, size_t NumPoints);
+
+/* Moves all the points of Other onto the end of Track, leaving Other
+ * empty. If a segment ended just before Other's first point, EndBefore
+ * should be set. Returns 0 if there's no memory for them. */
+int AppendTrack(struct GPSTrack* Track, struct GPSTrack* Other, int EndBefore);
+
+/* Copies point i of a track into Point. */
+void GetTrackPoint(const struct GPSTrack* Track, size_t i,
+		struct GPSPoint* Point);
+
+/* Returns the time of point i of a compact track. */
+time_t GetTrackTime(const struct GPSTrack* Track, size_t i);
+
+/* Turns a track into a compact one, after which no more points can be
+ * added. The decimal places are cut down to the 7 of the latitude and
+ * longitude and the 1 of the elevation that are kept. Returns 0 if the
+ * track has points that can't be kept that way, or there isn't the
+ * memory, in which case it's left as it was. */
+int CompactTrack(struct GPSTrack* Track);
+
+/* Sets the MinTime and MaxTime of a track from its points, and whether
+ * they're in order of time. */
+void GetTrackRange(struct GPSTrack* Track);
+
+/* Returns the first of the points First to Past - 1 of a track at or
+ * after Time, or Past if there isn't one. This is a binary search if the
+ * track is known to be in order, and a walk through them otherwise. */
+size_t FindTrackTime(const struct GPSTrack* Track, size_t First, size_t Past,
+		time_t Time);
+
+/* Fills in Stats for a track. */
+void GetTrackStats(const struct GPSTrack* Track, struct TrackStats* Stats);
+
+/* Frees the points of a track, leaving it empty. */
+void FreeTrack(struct GPSTrack* Track);
+
+#ifdef __cplusplus
+}
+#endif
@@ -27,268 +27,282 @@
 
 #include <stdio.h>
 #include <string.h>
-#include <locale.h>
 #include <libxml/parser.h>
 #include <libxml/tree.h>
+#include <libxml/parserInternals.h>
+#include <libxml/SAX2.h>
 
 #include "i18n.h"
 #include "gpx-read.h"
+#include "gpx-scan.h"
+#include "decompress.h"
+#include "track-load.h"
 #include "unixtime.h"
 #include "gpsstructure.h"
 #include "latlong.h"
 
-/* Pointers to the first and last points, used during parsing */
-static struct GPSPoint* FirstPoint;
-static struct GPSPoint* LastPoint;
-
-static void ExtractTrackPoints(xmlNodePtr Start)
+static void ExtractTrackPoint(xmlNodePtr Current, struct GPSTrack* Points)
 {
-	/* The pointer passed to us should be the start
-	 * of a heap of trkpt's. So walk though them,
-	 * extracting what we need. */
-	xmlNodePtr Current = NULL;
+	/* The node passed to us should be a trkpt.
+	 * Extract what we need from it. */
 	xmlNodePtr CCurrent = NULL;
 	xmlAttrPtr Properties = NULL;
-	const char* Lat;
-	const char* Long;
-	const char* Elev;
-	const char* Time;
+	const char* Lat = NULL;
+	const char* Long = NULL;
+	const char* Elev = NULL;
+	const char* Time = NULL;
 
-	for (Current = Start; Current; Current = Current->next)
+	/* To get the Lat and Long, we have to
+	 * extract the properties... another 
+	 * linked list to walk. */
+	for (Properties = Current->properties;
+			Properties;
+			Properties = Properties->next)
 	{
-		if ((Current->type == XML_ELEMENT_NODE) &&
-			(strcmp((const char *)Current->name, "trkpt") == 0))
+		if (strcmp((const char *)Properties->name, "lat") == 0)
 		{
-			/* This is indeed a trackpoint. Extract! */
+			Lat = (const char *)Properties->children->content;
+		}
+		if (strcmp((const char *)Properties->name, "lon") == 0)
+		{
+			Long = (const char *)Properties->children->content;
+		}
+	}
 
-			/* Reset the vars... so we don't get
-			 * the data from last run. */
-			Lat = NULL;
-			Long = NULL;
-			Elev = NULL;
-			Time = NULL;
-			
-			/* To get the Lat and Long, we have to
-			 * extract the properties... another 
-			 * linked list to walk. */
-			for (Properties = Current->properties;
-					Properties;
-					Properties = Properties->next)
-			{
-				if (strcmp((const char *)Properties->name, "lat") == 0)
-				{
-					Lat = (const char *)Properties->children->content;
-				}
-				if (strcmp((const char *)Properties->name, "lon") == 0)
-				{
-					Long = (const char *)Properties->children->content;
-				}
-			}
-
-			/* Now, grab the elevation and time.
-			 * These are children of trkpt. */
-			/* Oh, and what's the deal with the
-			 * Node->children->content thing? */
-			for (CCurrent = Current->children;
-					CCurrent;
-					CCurrent = CCurrent->next)
-			{
-				if (strcmp((const char *)CCurrent->name, "ele") == 0)
-				{
-					if (CCurrent->children)
-						Elev = (const char *)CCurrent->children->content;
-				}
-				if (strcmp((const char *)CCurrent->name, "time") == 0)
-				{
-					if (CCurrent->children)
-						Time = (const char *)CCurrent->children->content;
-				}
-			}
-
-			/* Check that we have all the data. If we're missing something,
-			 * then skip this point... NOTE: Elev is not required. */
-			if (Time == NULL || Long == NULL || Lat == NULL)
-			{
-				/* Missing some data. */
-				/* TODO: Really should report this upstream... */
-				continue;
-			}
-
-			/* Right, now we theoretically have all the data.
-			 * Allocate ourselves some memory and go for it... */
-			if (FirstPoint)
-			{
-				/* Ok, adding to the list... */
-				LastPoint->Next = NewGPSPoint();
-				LastPoint = LastPoint->Next;
-				LastPoint->Next = NULL;
-			} else {
-				/* This is the first one. */
-				FirstPoint = NewGPSPoint();
-				FirstPoint->Next = NULL;
-				LastPoint = FirstPoint;
-			}
-			if (LastPoint == NULL) {
-				fprintf(stderr, _("Out of memory.\n"));
-				abort();
-			}
-
-			/* Write the data into LastPoint, which should be a new point. */
-			LastPoint->Lat = atof(Lat);
-			LastPoint->LatDecimals = NumDecimals(Lat);
-			LastPoint->Long = atof(Long);
-			LastPoint->LongDecimals = NumDecimals(Long);
-			if (Elev) {
-				LastPoint->Elev = atof(Elev);
-				LastPoint->ElevDecimals = NumDecimals(Elev);
-			}
-			LastPoint->Time = ConvertToUnixTime(Time, GPX_DATE_FORMAT, 0, 0);
-			
-			/* Debug...
-			printf("TrackPoint. Lat %s (%f), Long %s (%f). Elev %s (%f), Time %d.\n",
-					Lat, atof(Lat), Long, atof(Long), Elev, atof(Elev),
-					ConvertToUnixTime(Time, GPX_DATE_FORMAT, 0, 0));
-			printf("Decimals %d %d %d\n", LastPoint->LatDecimals, LastPoint->LongDecimals, LastPoint->ElevDecimals);
-			*/
-			
-					
+	/* Now, grab the elevation and time.
+	 * These are children of trkpt. */
+	/* Oh, and what's the deal with the
+	 * Node->children->content thing? */
+	for (CCurrent = Current->children;
+			CCurrent;
+			CCurrent = CCurrent->next)
+	{
+		/* CDATA nodes don't have a name. */
+		if (CCurrent->type != XML_ELEMENT_NODE)
+			continue;
+		if (strcmp((const char *)CCurrent->name, "ele") == 0)
+		{
+			if (CCurrent->children)
+				Elev = (const char *)CCurrent->children->content;
+		}
+		if (strcmp((const char *)CCurrent->name, "time") == 0)
+		{
+			if (CCurrent->children)
+				Time = (const char *)CCurrent->children->content;
 		}
-	} /* End For. */
+	}
+
+	/* Check that we have all the data. If we're missing something,
+	 * then skip this point... NOTE: Elev is not required. */
+	if (Time == NULL || Long == NULL || Lat == NULL)
+	{
+		/* Missing some data. */
+		/* TODO: Really should report this upstream... */
+		return;
+	}
+
+	/* A time we can't make sense of is as good as none. */
+	time_t PointTime;
+	if (!ConvertGPXTime(Time, strlen(Time), &PointTime))
+	{
+		return;
+	}
 
-	/* Return control to the recursive function... */
+	/* Right, now we theoretically have all the data. */
+	struct GPSPoint Point;
+	Point.Lat = ParseDecimal(Lat, NULL, &Point.LatDecimals);
+	Point.Long = ParseDecimal(Long, NULL, &Point.LongDecimals);
+	if (Elev) {
+		Point.Elev = ParseDecimal(Elev, NULL, &Point.ElevDecimals);
+	} else {
+		/* No altitude was found */
+		Point.Elev = 0;
+		Point.ElevDecimals = -1;
+	}
+	Point.Time = PointTime;
+
+	/* Add it on to the end of the track. */
+	if (!AddTrackPoint(Points, &Point)) {
+		fprintf(stderr, _("Out of memory.\n"));
+		abort();
+	}
+
+	/* Debug...
+	printf("TrackPoint. Lat %s (%f), Long %s (%f). Elev %s (%f), Time %d.\n",
+			Lat, atof(Lat), Long, atof(Long), Elev, atof(Elev),
+			(int) PointTime);
+	printf("Decimals %d %d %d\n", Point.LatDecimals, Point.LongDecimals, Point.ElevDecimals);
+	*/
 }
 
-static void FindTrackSeg(xmlNodePtr Start)
+/* Returns nonzero if the node is an element with the given name. */
+static int IsElement(xmlNodePtr Node, const char* Name)
 {
-	/* Go recursive till we find a <trgseg> tag. */
-	xmlNodePtr Current = NULL;
+	return Node && (Node->type == XML_ELEMENT_NODE) &&
+		(strcmp((const char *)Node->name, Name) == 0);
+}
+
+/* Called by the parser at the end of each element, once its node is
+ * complete. libxml builds the tree as usual, but we pull the data out of
+ * each <trkpt> directly inside a <trkseg> as soon as it has been read,
+ * and then throw away the parts of the tree we're done with. That way,
+ * only a few nodes are ever held in memory, no matter how large the file
+ * is, and we never have to walk the tree a second time. */
+static void EndElement(void* Ctx, const xmlChar* LocalName,
+		const xmlChar* Prefix, const xmlChar* URI)
+{
+	xmlParserCtxtPtr Context = (xmlParserCtxtPtr) Ctx;
+	struct GPSTrack* Points = (struct GPSTrack*) Context->_private;
+	xmlNodePtr Current = Context->node;
+	xmlNodePtr Root;
+	xmlNodePtr Prev;
+	int Finished = 0;
 
-	for (Current = Start; Current; Current = Current->next)
+	/* Let libxml finish off the node. */
+	xmlSAX2EndElementNs(Ctx, LocalName, Prefix, URI);
+
+	if (Current == NULL || Current->parent == NULL ||
+		Current->parent->type != XML_ELEMENT_NODE)
 	{
-		if ((Current->type == XML_ELEMENT_NODE) &&
-			(strcmp((const char *)Current->name, "trkseg") == 0))
+		/* This is the root element. It's freed with the document. */
+		return;
+	}
+
+	/* Only look for data if this is a GPX file - the root node
+	 * should be "gpx". */
+	Root = xmlDocGetRootElement(Context->myDoc);
+	if (IsElement(Root, "gpx"))
+	{
+		if (IsElement(Current, "trkpt") && IsElement(Current->parent, "trkseg"))
+		{
+			/* This is indeed a trackpoint. Extract! */
+			ExtractTrackPoint(Current, Points);
+			Finished = 1;
+
+		} else if (IsElement(Current, "trkseg"))
 		{
-			/* Found it... the children should
-			 * all be trkpt's. */
-			ExtractTrackPoints(Current->children);
-			
 			/* Mark the last point as being the end
 			 * of a track segment. */
-			if (LastPoint) LastPoint->EndOfSegment = 1;
-			
+			EndTrackSegment(Points);
 		}
-		
-		/* And again, with children of this node. */
-		FindTrackSeg(Current->children);
-		
-	} /* End For */
-
-}
-
-/* Determines and stores the min and max times from the GPS track */
-static void GetTrackRange(struct GPSTrack* Track)
-{
-	if (Track->Points == NULL)
-		return;
+	}
 
-	/* Requires us to go through the list and keep
-	 * the biggest and smallest. The list should,
-	 * however, be sorted. But we do it this way anyway. */
-	const struct GPSPoint* Fill = NULL;
-	Track->MaxTime = 0;
-	Track->MinTime = Track->Points->Time;
-	for (Fill = Track->Points; Fill; Fill = Fill->Next)
+	/* Everything directly under the root can go once it's complete,
+	 * as can a trkpt and whatever came before it in its segment. */
+	if (Finished || Current->parent == Root)
 	{
-		/* Check the Min time */
-		if (Fill->Time < Track->MinTime)
-			Track->MinTime = Fill->Time;
-		/* Check the Max time */
-		if (Fill->Time > Track->MaxTime) 
-			Track->MaxTime = Fill->Time;
+		while ((Prev = Current->prev) != NULL)
+		{
+			xmlUnlinkNode(Prev);
+			xmlFreeNode(Prev);
+		}
+		xmlUnlinkNode(Current);
+		xmlFreeNode(Current);
 	}
 }
 
+/* Feeds decompressed data to the parser. */
+static int ReadDecompressed(void* Ctx, char* Buffer, int Len)
+{
+	return ReadCompressed((struct Decompressor*) Ctx, Buffer, Len);
+}
 
 int ReadGPX(const char* File, struct GPSTrack* Track)
 {
 	/* Init the libxml library. Also checks version. */
 	LIBXML_TEST_VERSION
 
-	xmlDocPtr GPXData;
+	xmlParserCtxtPtr Context;
+	struct Decompressor* Compressed;
+	struct GPSTrack Points;
+	xmlNodePtr GPXRoot;
+	int WellFormed;
+	int IsGPX;
 	
-	/* Read the GPX data from file. */
-	GPXData = xmlParseFile(File);
-	if (GPXData == NULL)
+	/* A compressed file is decompressed bit by bit as it's parsed,
+	 * so the full parser is needed for it. Most other GPX files are
+	 * simple enough to be read straight from the file, which is much
+	 * faster. The full parser is only needed for those that aren't. */
+	Compressed = OpenCompressed(File);
+	if (Compressed == NULL && ScanGPX(File, Track))
 	{
-		fprintf(stderr, _("Failed to parse GPX data from %s.\n"), File);
-		xmlCleanupParser();
-		return 0;
+		GetTrackRange(Track);
+		return 1;
 	}
 
-	/* Now grab the "root" node. */
-	xmlNodePtr GPXRoot;
-	GPXRoot = xmlDocGetRootElement(GPXData);
-
-	if (GPXRoot == NULL)
+	/* Open the GPX file. This is the same as xmlParseFile() does, but we
+	 * want to see the data as it is read, not once it's all in memory. */
+	if (Compressed)
 	{
-		fprintf(stderr, _("Invalid GPX file has no root.\n"));
-		xmlFreeDoc(GPXData);
-		xmlCleanupParser();
-		return 0;
+		Context = xmlCreateIOParserCtxt(NULL, NULL, ReadDecompressed, NULL,
+				Compressed, XML_CHAR_ENCODING_NONE);
+		/* Give the name in any error messages, as for a plain file */
+		if (Context && Context->input && Context->input->filename == NULL)
+			Context->input->filename = (const char*) xmlStrdup((const xmlChar*) File);
+	} else {
+		Context = xmlCreateFileParserCtxt(File);
 	}
-
-	/* Check that this is indeed a GPX - the root node
-	 * should be "gpx". */
-	if (strcmp((const char *)GPXRoot->name, "gpx") == 0)
+	if (Context == NULL)
 	{
-		/* Ok, it is a GPX file. */
-	} else {
-		/* Not valid. */
-		fprintf(stderr, _("Invalid GPX file.\n"));
-		xmlFreeDoc(GPXData);
-		xmlCleanupParser();
+		TrackReadError(_("Failed to parse GPX data from %s.\n"), File);
+		CloseCompressed(Compressed);
 		return 0;
 	}
+	Context->sax->endElementNs = EndElement;
+	Context->_private = &Points;
 
-	/* Now comes the messy part... walking the tree to find
-	 * what we want.
-	 * I've chosen to do it with two functions, one of which
-	 * is recursive, rather than a clever inside-this-function
-	 * walk the tree thing.
-	 * 
-	 * We start by calling the recursive function to look for
-	 * <trkseg> tags, and then that function calls another
-	 * when it has found one... this sub function then
-	 * hauls out the <trkpt> tags with the actual data.
+	/* Now comes the messy part... finding what we want as the
+	 * parser goes through the document.
+	 * Each time an element has been read in, EndElement() looks at
+	 * what it was. If it was a <trkpt> inside a <trkseg>, it hauls out
+	 * the actual data then throws the element away. The end of a
+	 * <trkseg> marks the end of a segment.
 	 * Messy, convoluted, but it seems to work... */
-	/* As to where to store the data? Again, its messy.
-	 * We maintain two global vars, FirstPoint and LastPoint.
-	 * FirstPoint points to the first GPSPoint done, and
-	 * LastPoint is the last point done, used for the next
-	 * point... we use this to build a singly-linked list. */
+	/* As to where to store the data? Each point is added on to
+	 * the end of a track as it's found. */
 	/* (I think I'll just be grateful for the work that libxml
 	 * puts in for me... imagine having to write an XML parser!
 	 * Nasty.) */
-	/* Before we go into this function, we also setlocale to "C".
-	 * The GPX def indicates that the decimal separator should be
-	 * ".", but certain locales specify otherwise. Which has caused issues.
-	 * So we set the locale for this function, and then revert it.
-	 */
-	
-	FirstPoint = NULL;
-	LastPoint = NULL;
+	memset(&Points, 0, sizeof(Points));
 	
-	char* OldLocale = setlocale(LC_NUMERIC, "C");
-	
-	FindTrackSeg(GPXRoot);
+	/* The GPX def indicates that the decimal separator should be
+	 * ".", whatever the locale. ParseDecimal takes care of that. */
+	xmlParseDocument(Context);
+
+	/* See what we ended up with. */
+	WellFormed = Context->wellFormed;
+	GPXRoot = Context->myDoc ? xmlDocGetRootElement(Context->myDoc) : NULL;
+	IsGPX = IsElement(GPXRoot, "gpx");
+
+	if (!WellFormed)
+	{
+		TrackReadError(_("Failed to parse GPX data from %s.\n"), File);
+
+	} else if (GPXRoot == NULL)
+	{
+		TrackReadError(_("Invalid GPX file has no root.\n"));
+
+	} else if (!IsGPX)
+	{
+		/* Not valid. */
+		TrackReadError(_("Invalid GPX file.\n"));
+	}
 
-	setlocale(LC_NUMERIC, OldLocale);
+	/* Clean up stuff for the XML library. xmlCleanupParser() isn't
+	 * called, as other threads may still be using libxml. */
+	if (Context->myDoc)
+		xmlFreeDoc(Context->myDoc);
+	xmlFreeParserCtxt(Context);
+	CloseCompressed(Compressed);
 
-	/* Clean up stuff for the XML library. */
-	xmlFreeDoc(GPXData);
-	xmlCleanupParser();
+	if (!WellFormed || !IsGPX)
+	{
+		/* Throw away anything read before the problem was found. */
+		FreeTrack(&Points);
+		return 0;
+	}
 
-	Track->Points = FirstPoint;
+	*Track = Points;
 
 	/* Find the time range for this track */
 	GetTrackRange(Track);
@@ -296,19 +310,3 @@ int ReadGPX(const char* File, struct GPSTrack* Track)
 	return 1;
 }
 
-
-void FreeTrack(struct GPSTrack* Track)
-{
-	/* Free the memory associated with the
-	 * GPSPoint list... */
-	struct GPSPoint* NextFree = NULL;
-	struct GPSPoint* CurrentFree = Track->Points;
-	while (1)
-	{
-		if (CurrentFree == NULL) break;
-		NextFree = CurrentFree->Next;
-		free(CurrentFree);
-		CurrentFree = NextFree;
-	}
-	Track->Points = NULL;
-}
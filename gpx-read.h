@@ -28,4 +28,3 @@
 struct GPSTrack;
 
 int ReadGPX(const char* File, struct GPSTrack* Track);
-void FreeTrack(struct GPSTrack* Track);
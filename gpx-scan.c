@@ -0,0 +1,1066 @@
+/* gpx-scan.c
+ * This file contains a fast scanner for GPX files. It maps the file
+ * into memory and picks the track points straight out of the bytes,
+ * without building any XML nodes along the way.
+ *
+ * It only understands a subset of XML: elements, attributes, comments,
+ * the XML declaration, the predefined entities, and CDATA sections where
+ * they don't hold any data we want. Anything else (DOCTYPEs, character
+ * references, processing instructions, encodings other than UTF-8 or
+ * ISO-8859-1, odd namespace usage, or anything that isn't well-formed)
+ * makes it give up, and the file is then read again by libxml in
+ * gpx-read.c. That way, the results and any error messages are always
+ * those of libxml.
+ *
+ * Large files are split up into chunks starting at <trkpt> tags, which
+ * are scanned on separate threads and then joined back together in
+ * order. A chunk can't see the elements it's inside of, so it keeps a
+ * note of the end tags and namespace prefixes it needed from them, and
+ * these are checked against the real thing as the chunks are joined.
+ */
+
+/* Copyright 2026 the gpscorrelate authors.
+ *
+ * This file is part of gpscorrelate.
+ *
+ * gpscorrelate is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * gpscorrelate is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with gpscorrelate; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
+
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
+#include "i18n.h"
+#include "gpx-scan.h"
+#include "track-load.h"
+#include "unixtime.h"
+#include "gpsstructure.h"
+#include "latlong.h"
+
+/* Limits beyond which we let libxml deal with the file. These are well
+ * below the limits libxml itself enforces. */
+#define MAX_DEPTH 64
+#define MAX_PREFIXES 64
+#define MAX_ATTRS 32
+#define MAX_NAME 1000
+#define MAX_TEXT 1000000
+
+/* Large files are split into chunks of at least this size, which are
+ * scanned in parallel. */
+#define MIN_CHUNK (4 * 1024 * 1024)
+#define MAX_CHUNKS 256
+
+/* A piece of the mapped file. It is NOT nul terminated. */
+struct Span {
+	const char* Start;
+	size_t Len;
+};
+
+struct Attr {
+	struct Span Name;	/* Qualified name */
+	struct Span Local;	/* Name without any namespace prefix */
+	struct Span Value;
+	int HasRef;		/* Value contains an entity reference */
+};
+
+/* Something a chunk relies on from the part of the file before it. */
+struct Need {
+	int Closes;		/* Set if it's an end tag, else a namespace prefix */
+	struct Span Name;
+	const char* After;	/* Where the end tag finished */
+};
+
+struct Element {
+	struct Span Name;
+	struct Span Local;
+	int Prefixes;		/* Namespace prefixes in scope before this one */
+};
+
+struct Scanner {
+	const char* Pos;
+	const char* End;
+
+	struct Element Stack[MAX_DEPTH];
+	int Depth;
+	struct Span Prefixes[MAX_PREFIXES];
+	int NumPrefixes;
+
+	/* The trkpt currently being read, if InPoint is set. */
+	int InPoint;
+	int PointDepth;
+	struct Span Lat;
+	struct Span Long;
+	struct Span Elev;
+	struct Span Time;
+	/* Where to put the text of the current element, if anywhere. */
+	struct Span* Capture;
+
+	/* The file is in ISO-8859-1 rather than UTF-8 */
+	int Latin1;
+	int SeenRoot;
+
+	/* Set when scanning a chunk that starts part way through the file,
+	 * at a trkpt tag inside a trkseg. The elements it's inside of aren't
+	 * known, so whatever the chunk needs from them goes in Needs, to be
+	 * checked once the chunks before it are done. */
+	int Chunk;
+	int Closed;		/* How many of those elements were closed */
+	int MarkBefore;		/* A segment ended before the first point */
+	struct Need* Needs;
+	int NumNeeds;
+	int MaxNeeds;
+	int Ok;
+
+	struct GPSTrack Points;
+};
+
+static int SpanIs(struct Span S, const char* Str)
+{
+	return (strlen(Str) == S.Len) && (memcmp(S.Start, Str, S.Len) == 0);
+}
+
+static int SpanEqual(struct Span A, struct Span B)
+{
+	return (A.Len == B.Len) && (memcmp(A.Start, B.Start, A.Len) == 0);
+}
+
+static int IsSpace(char c)
+{
+	return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+static int IsNameStart(char c)
+{
+	return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+}
+
+static int IsNameChar(char c)
+{
+	return IsNameStart(c) || (c >= '0' && c <= '9') || c == '-' ||
+		c == '.' || c == ':';
+}
+
+/* Returns the number of whitespace characters skipped. */
+static int SkipSpace(struct Scanner* S)
+{
+	const char* Start = S->Pos;
+	while (S->Pos < S->End && IsSpace(*S->Pos))
+		S->Pos++;
+	return S->Pos != Start;
+}
+
+/* Returns the length of the valid UTF-8 encoded XML character at p,
+ * or 0 if it isn't one. */
+static size_t Utf8Len(const unsigned char* p, const unsigned char* End)
+{
+	unsigned long c;
+	size_t n, i;
+
+	if (p[0] < 0xC2) {
+		return 0;
+	} else if (p[0] < 0xE0) {
+		n = 2;
+		c = p[0] & 0x1F;
+	} else if (p[0] < 0xF0) {
+		n = 3;
+		c = p[0] & 0x0F;
+	} else if (p[0] < 0xF5) {
+		n = 4;
+		c = p[0] & 0x07;
+	} else {
+		return 0;
+	}
+	if ((size_t)(End - p) < n)
+		return 0;
+	for (i = 1; i < n; i++) {
+		if ((p[i] & 0xC0) != 0x80)
+			return 0;
+		c = (c << 6) | (p[i] & 0x3F);
+	}
+	/* Overlong forms, surrogates and the non-characters XML forbids */
+	if ((n == 3 && c < 0x800) || (n == 4 && (c < 0x10000 || c > 0x10FFFF)) ||
+	    (c >= 0xD800 && c <= 0xDFFF) || c == 0xFFFE || c == 0xFFFF)
+		return 0;
+	return n;
+}
+
+/* Returns the length of the non-ASCII character at p, or 0 if it
+ * isn't a valid one. */
+static size_t CharLen(const struct Scanner* S, const char* p, const char* End)
+{
+	/* Every byte is a character in ISO-8859-1 */
+	if (S->Latin1)
+		return 1;
+	return Utf8Len((const unsigned char*) p, (const unsigned char*) End);
+}
+
+/* Returns the length of the entity reference at p, or 0 if it isn't
+ * one of the predefined ones. */
+static size_t RefLen(const char* p, const char* End)
+{
+	static const char* const Refs[] = {
+		"&amp;", "&lt;", "&gt;", "&quot;", "&apos;"
+	};
+	size_t i, Len;
+
+	for (i = 0; i < sizeof(Refs) / sizeof(Refs[0]); i++) {
+		Len = strlen(Refs[i]);
+		if ((size_t)(End - p) >= Len && memcmp(p, Refs[i], Len) == 0)
+			return Len;
+	}
+	return 0;
+}
+
+/* Checks that everything from p up to End is valid character data. */
+static int CheckChars(const struct Scanner* S, const char* p, const char* End)
+{
+	size_t Len;
+
+	while (p < End) {
+		unsigned char c = (unsigned char) *p;
+		if (c >= 0x20 && c < 0x80) {
+			p++;
+		} else if (c == '\t' || c == '\n' || c == '\r') {
+			p++;
+		} else if (c >= 0x80 &&
+			   (Len = CharLen(S, p, End)) != 0) {
+			p += Len;
+		} else {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+/* Reads (possibly prefixed) name. Only plain ASCII names are accepted. */
+static int ScanName(struct Scanner* S, struct Span* Name, struct Span* Local)
+{
+	const char* Colon = NULL;
+
+	Name->Start = S->Pos;
+	if (S->Pos >= S->End || !IsNameStart(*S->Pos))
+		return 0;
+	while (S->Pos < S->End && IsNameChar(*S->Pos)) {
+		if (*S->Pos == ':') {
+			/* Only one colon is allowed, and not at the start */
+			if (Colon || S->Pos == Name->Start)
+				return 0;
+			Colon = S->Pos;
+		}
+		S->Pos++;
+	}
+	if (S->Pos >= S->End || (unsigned char) *S->Pos >= 0x80)
+		return 0;
+	Name->Len = S->Pos - Name->Start;
+	if (Name->Len > MAX_NAME || (Colon && Colon == S->Pos - 1))
+		return 0;
+
+	if (Colon) {
+		Local->Start = Colon + 1;
+		Local->Len = S->Pos - Local->Start;
+	} else {
+		*Local = *Name;
+	}
+	return 1;
+}
+
+/* Reads character data up to the next '<' (or the end of the file).
+ * Sets HasRef if any entity references were found. */
+static int ScanText(struct Scanner* S, int* HasRef)
+{
+	const char* Start = S->Pos;
+	const char* p = S->Pos;
+	size_t Len;
+
+	while (p < S->End) {
+		unsigned char c = (unsigned char) *p;
+		if (c >= 0x20 && c < 0x80 && c != '<' && c != '&' && c != ']') {
+			p++;
+		} else if (c == '<') {
+			break;
+		} else if (c == '\t' || c == '\n' || c == '\r') {
+			p++;
+		} else if (c == '&') {
+			if ((Len = RefLen(p, S->End)) == 0)
+				return 0;
+			*HasRef = 1;
+			p += Len;
+		} else if (c == ']') {
+			/* "]]>" isn't allowed in text */
+			if (S->End - p >= 3 && p[1] == ']' && p[2] == '>')
+				return 0;
+			p++;
+		} else if (c >= 0x80 &&
+			   (Len = CharLen(S, p, S->End)) != 0) {
+			p += Len;
+		} else {
+			return 0;
+		}
+	}
+	if (p - Start > MAX_TEXT)
+		return 0;
+	S->Pos = p;
+	return 1;
+}
+
+/* Reads a quoted attribute value. */
+static int ScanAttValue(struct Scanner* S, struct Span* Value, int* HasRef)
+{
+	char Quote;
+	const char* p;
+	size_t Len;
+
+	if (S->Pos >= S->End || (*S->Pos != '"' && *S->Pos != '\''))
+		return 0;
+	Quote = *S->Pos++;
+	*HasRef = 0;
+
+	for (p = S->Pos; p < S->End && *p != Quote; ) {
+		unsigned char c = (unsigned char) *p;
+		if (c >= 0x20 && c < 0x80 && c != '<' && c != '&') {
+			p++;
+		} else if (c == '\t' || c == '\n' || c == '\r') {
+			p++;
+		} else if (c == '&') {
+			if ((Len = RefLen(p, S->End)) == 0)
+				return 0;
+			*HasRef = 1;
+			p += Len;
+		} else if (c >= 0x80 &&
+			   (Len = CharLen(S, p, S->End)) != 0) {
+			p += Len;
+		} else {
+			return 0;
+		}
+	}
+	if (p >= S->End || p - S->Pos > MAX_TEXT)
+		return 0;
+
+	Value->Start = S->Pos;
+	Value->Len = p - S->Pos;
+	S->Pos = p + 1;
+	return 1;
+}
+
+/* Checks that a namespace name is something libxml will accept as
+ * an absolute URI without complaint. */
+static int IsPlainURI(struct Span URI)
+{
+	static const char Allowed[] = "-._~:/?#@!$'()*+,;=";
+	size_t i = 0;
+
+	if (URI.Len == 0 || !IsNameStart(URI.Start[0]) || URI.Start[0] == '_')
+		return 0;
+	/* The scheme */
+	while (i < URI.Len && ((URI.Start[i] >= 'a' && URI.Start[i] <= 'z') ||
+		(URI.Start[i] >= 'A' && URI.Start[i] <= 'Z') ||
+		(URI.Start[i] >= '0' && URI.Start[i] <= '9') ||
+		URI.Start[i] == '+' || URI.Start[i] == '-' || URI.Start[i] == '.'))
+		i++;
+	if (i >= URI.Len || URI.Start[i] != ':')
+		return 0;
+	for (; i < URI.Len; i++) {
+		char c = URI.Start[i];
+		if (c == '%') {
+			/* Must be an escaped byte */
+			if (i + 2 >= URI.Len || !isxdigit((unsigned char) URI.Start[i+1]) ||
+			    !isxdigit((unsigned char) URI.Start[i+2]))
+				return 0;
+		} else if (!((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+		      (c >= '0' && c <= '9') || strchr(Allowed, c)))
+			return 0;
+	}
+	return 1;
+}
+
+/* Returns nonzero if the attribute is a namespace declaration. */
+static int IsNsDecl(const struct Attr* A)
+{
+	return SpanIs(A->Name, "xmlns") ||
+		(A->Name.Len > 6 && memcmp(A->Name.Start, "xmlns:", 6) == 0);
+}
+
+/* Notes something the chunk needs from before it. */
+static int AddNeed(struct Scanner* S, int Closes, struct Span Name)
+{
+	int i;
+
+	if (!Closes) {
+		/* The same prefix is usually used over and over */
+		for (i = S->NumNeeds - 1; i >= 0 && !S->Needs[i].Closes; i--) {
+			if (SpanEqual(S->Needs[i].Name, Name))
+				return 1;
+		}
+	}
+	if (S->NumNeeds == S->MaxNeeds) {
+		int Max = S->MaxNeeds ? S->MaxNeeds * 2 : 16;
+		struct Need* Needs = (struct Need*) realloc(S->Needs, Max * sizeof(*Needs));
+		if (Needs == NULL)
+			return 0;
+		S->Needs = Needs;
+		S->MaxNeeds = Max;
+	}
+	S->Needs[S->NumNeeds].Closes = Closes;
+	S->Needs[S->NumNeeds].Name = Name;
+	S->Needs[S->NumNeeds].After = S->Pos;
+	S->NumNeeds++;
+	return 1;
+}
+
+/* Returns nonzero if the prefix of the given qualified name, if any,
+ * has been declared. */
+static int PrefixDeclared(struct Scanner* S, struct Span Name, struct Span Local)
+{
+	struct Span Prefix;
+	int i;
+
+	if (Name.Len == Local.Len)
+		return 1;
+	Prefix.Start = Name.Start;
+	Prefix.Len = Name.Len - Local.Len - 1;
+	if (SpanIs(Prefix, "xml"))
+		return 1;
+	for (i = 0; i < S->NumPrefixes; i++) {
+		if (SpanEqual(S->Prefixes[i], Prefix))
+			return 1;
+	}
+	/* It might have been declared before the chunk */
+	if (S->Chunk)
+		return AddNeed(S, 0, Prefix);
+	return 0;
+}
+
+/* Adds a point to the list, just as gpx-read.c would from libxml. */
+static int AddPoint(struct Scanner* S)
+{
+	struct GPSPoint Point;
+	time_t Time;
+
+	/* Check that we have all the data. If we're missing something,
+	 * then skip this point... NOTE: Elev is not required. */
+	if (S->Time.Start == NULL || S->Long.Start == NULL || S->Lat.Start == NULL)
+		return 1;
+
+	/* A time we can't make sense of is as good as none. */
+	if (!ConvertGPXTime(S->Time.Start, S->Time.Len, &Time))
+		return 1;
+
+	Point.Lat = ParseDecimal(S->Lat.Start, S->Lat.Start + S->Lat.Len,
+			&Point.LatDecimals);
+	Point.Long = ParseDecimal(S->Long.Start, S->Long.Start + S->Long.Len,
+			&Point.LongDecimals);
+	if (S->Elev.Start) {
+		Point.Elev = ParseDecimal(S->Elev.Start, S->Elev.Start + S->Elev.Len,
+				&Point.ElevDecimals);
+	} else {
+		Point.Elev = 0;
+		Point.ElevDecimals = -1;
+	}
+	Point.Time = Time;
+
+	if (!AddTrackPoint(&S->Points, &Point)) {
+		fprintf(stderr, _("Out of memory.\n"));
+		abort();
+	}
+
+	return 1;
+}
+
+/* Mark the last point as being the end of a track segment. */
+static void EndSegment(struct Scanner* S)
+{
+	if (S->Points.NumPoints)
+		EndTrackSegment(&S->Points);
+	else if (S->Chunk)
+		S->MarkBefore = 1;
+}
+
+/* Called at the end of every element. */
+static int EndElement(struct Scanner* S)
+{
+	struct Element* E = &S->Stack[--S->Depth];
+
+	S->NumPrefixes = E->Prefixes;
+	if (S->InPoint && S->Depth + 1 == S->PointDepth) {
+		S->InPoint = 0;
+		return AddPoint(S);
+	}
+	if (SpanIs(E->Local, "trkseg"))
+		EndSegment(S);
+	return 1;
+}
+
+static int ScanStartTag(struct Scanner* S)
+{
+	struct Attr Attrs[MAX_ATTRS];
+	int NumAttrs = 0;
+	struct Element* E;
+	struct Element* Parent;
+	int Empty = 0;
+	int i, j;
+
+	if (S->Depth >= MAX_DEPTH)
+		return 0;
+	E = &S->Stack[S->Depth];
+	E->Prefixes = S->NumPrefixes;
+
+	S->Pos++;
+	if (!ScanName(S, &E->Name, &E->Local))
+		return 0;
+
+	for (;;) {
+		struct Attr* A;
+		int Space = SkipSpace(S);
+
+		if (S->Pos >= S->End)
+			return 0;
+		if (*S->Pos == '>') {
+			S->Pos++;
+			break;
+		}
+		if (*S->Pos == '/') {
+			if (S->Pos + 1 >= S->End || S->Pos[1] != '>')
+				return 0;
+			S->Pos += 2;
+			Empty = 1;
+			break;
+		}
+		/* Attributes must be separated by whitespace */
+		if (!Space || NumAttrs >= MAX_ATTRS)
+			return 0;
+
+		A = &Attrs[NumAttrs++];
+		if (!ScanName(S, &A->Name, &A->Local))
+			return 0;
+		SkipSpace(S);
+		if (S->Pos >= S->End || *S->Pos != '=')
+			return 0;
+		S->Pos++;
+		SkipSpace(S);
+		if (!ScanAttValue(S, &A->Value, &A->HasRef))
+			return 0;
+	}
+
+	/* Namespace declarations come first, as they apply to the element
+	 * they appear on. */
+	for (i = 0; i < NumAttrs; i++) {
+		struct Attr* A = &Attrs[i];
+		if (SpanIs(A->Name, "xmlns")) {
+			if (A->Value.Len && (A->HasRef || !IsPlainURI(A->Value)))
+				return 0;
+		} else if (A->Name.Len > 6 && memcmp(A->Name.Start, "xmlns:", 6) == 0) {
+			if (SpanIs(A->Local, "xml") || SpanIs(A->Local, "xmlns") ||
+			    A->HasRef || !IsPlainURI(A->Value) ||
+			    S->NumPrefixes >= MAX_PREFIXES)
+				return 0;
+			S->Prefixes[S->NumPrefixes++] = A->Local;
+		}
+	}
+	if (!PrefixDeclared(S, E->Name, E->Local))
+		return 0;
+	for (i = 0; i < NumAttrs; i++) {
+		struct Attr* A = &Attrs[i];
+		if (!IsNsDecl(A) && !PrefixDeclared(S, A->Name, A->Local))
+			return 0;
+		/* No repeats, even in different namespaces */
+		for (j = 0; j < i; j++) {
+			if (SpanEqual(A->Local, Attrs[j].Local))
+				return 0;
+		}
+	}
+
+	Parent = S->Depth ? &S->Stack[S->Depth - 1] : NULL;
+	S->Depth++;
+
+	/* Now see whether it's something we're interested in. */
+	if (Parent == NULL && !S->Chunk) {
+		/* Only read on if this is a GPX file - the root node
+		 * should be "gpx". */
+		if (!SpanIs(E->Local, "gpx"))
+			return 0;
+
+	} else if (S->InPoint) {
+		/* libxml handles segments within points rather differently */
+		if (SpanIs(E->Local, "trkpt") || SpanIs(E->Local, "trkseg"))
+			return 0;
+		if (S->Depth == S->PointDepth + 1 && !Empty) {
+			if (SpanIs(E->Local, "ele"))
+				S->Capture = &S->Elev;
+			else if (SpanIs(E->Local, "time"))
+				S->Capture = &S->Time;
+		}
+
+	} else if (SpanIs(E->Local, "trkpt") && Parent == NULL && S->Closed) {
+		/* Chunks start in a trkseg, but after closing that, there's
+		 * no telling what the parent of a trkpt is (it could be an
+		 * outer trkseg), so leave it to a scan of the whole file. */
+		return 0;
+
+	} else if (SpanIs(E->Local, "trkpt") &&
+		   (Parent == NULL || SpanIs(Parent->Local, "trkseg"))) {
+		/* This is indeed a trackpoint. */
+		S->InPoint = 1;
+		S->PointDepth = S->Depth;
+		S->Lat.Start = S->Long.Start = S->Elev.Start = S->Time.Start = NULL;
+
+		for (i = 0; i < NumAttrs; i++) {
+			struct Attr* A = &Attrs[i];
+			struct Span* Target = NULL;
+			if (IsNsDecl(A))
+				continue;
+			if (SpanIs(A->Local, "lat"))
+				Target = &S->Lat;
+			else if (SpanIs(A->Local, "lon"))
+				Target = &S->Long;
+			if (Target) {
+				if (A->HasRef || A->Value.Len == 0)
+					return 0;
+				*Target = A->Value;
+			}
+		}
+	}
+
+	if (Empty)
+		return EndElement(S);
+	return 1;
+}
+
+static int ScanEndTag(struct Scanner* S)
+{
+	struct Span Name, Local;
+
+	S->Pos += 2;
+	if (!ScanName(S, &Name, &Local))
+		return 0;
+	SkipSpace(S);
+	if (S->Pos >= S->End || *S->Pos != '>')
+		return 0;
+	S->Pos++;
+
+	if (S->Depth == 0) {
+		/* Closing one of the elements the chunk started inside of */
+		if (!S->Chunk || !AddNeed(S, 1, Name))
+			return 0;
+		S->Closed++;
+		if (SpanIs(Local, "trkseg"))
+			EndSegment(S);
+		return 1;
+	}
+	if (!SpanEqual(Name, S->Stack[S->Depth - 1].Name))
+		return 0;
+	return EndElement(S);
+}
+
+static int ScanComment(struct Scanner* S)
+{
+	const char* Start = S->Pos + 4;
+	const char* p;
+
+	for (p = Start; p + 1 < S->End; p++) {
+		if (p[0] == '-' && p[1] == '-')
+			break;
+	}
+	/* "--" may only appear at the end */
+	if (p + 2 >= S->End || p[2] != '>' || !CheckChars(S, Start, p))
+		return 0;
+	S->Pos = p + 3;
+	return 1;
+}
+
+static int ScanCData(struct Scanner* S)
+{
+	const char* Start = S->Pos + 9;
+	const char* p;
+
+	for (p = Start; p + 2 < S->End; p++) {
+		if (p[0] == ']' && p[1] == ']' && p[2] == '>')
+			break;
+	}
+	if (p + 2 >= S->End || !CheckChars(S, Start, p))
+		return 0;
+	S->Pos = p + 3;
+	return 1;
+}
+
+/* Reads one pseudo-attribute from the XML declaration, if it's there. */
+static int ScanPseudoAttr(struct Scanner* S, const char* Name, struct Span* Value)
+{
+	const char* Start = S->Pos;
+	size_t Len = strlen(Name);
+	int HasRef;
+
+	if (SkipSpace(S) && (size_t)(S->End - S->Pos) > Len &&
+	    memcmp(S->Pos, Name, Len) == 0 && !IsNameChar(S->Pos[Len])) {
+		S->Pos += Len;
+		SkipSpace(S);
+		if (S->Pos < S->End && *S->Pos == '=') {
+			S->Pos++;
+			SkipSpace(S);
+			if (ScanAttValue(S, Value, &HasRef) && !HasRef)
+				return 1;
+		}
+	}
+	S->Pos = Start;
+	return 0;
+}
+
+/* Reads the optional byte order mark and XML declaration. */
+static int ScanProlog(struct Scanner* S)
+{
+	struct Span Value;
+	size_t i;
+
+	if (S->End - S->Pos >= 3 && memcmp(S->Pos, "\xEF\xBB\xBF", 3) == 0)
+		S->Pos += 3;
+	if (S->End - S->Pos < 6 || memcmp(S->Pos, "<?xml", 5) != 0 ||
+	    !IsSpace(S->Pos[5]))
+		return 1;
+	S->Pos += 5;
+
+	if (!ScanPseudoAttr(S, "version", &Value) || !SpanIs(Value, "1.0"))
+		return 0;
+	if (ScanPseudoAttr(S, "encoding", &Value)) {
+		char Encoding[16];
+		if (Value.Len >= sizeof(Encoding))
+			return 0;
+		for (i = 0; i < Value.Len; i++) {
+			char c = Value.Start[i];
+			if (c >= 'A' && c <= 'Z')
+				c += 'a' - 'A';
+			Encoding[i] = c;
+		}
+		Encoding[i] = '\0';
+		if (strcmp(Encoding, "iso-8859-1") == 0)
+			S->Latin1 = 1;
+		else if (strcmp(Encoding, "utf-8") != 0)
+			return 0;
+	}
+	if (ScanPseudoAttr(S, "standalone", &Value) &&
+	    !SpanIs(Value, "yes") && !SpanIs(Value, "no"))
+		return 0;
+	SkipSpace(S);
+	if (S->End - S->Pos < 2 || memcmp(S->Pos, "?>", 2) != 0)
+		return 0;
+	S->Pos += 2;
+	return 1;
+}
+
+/* Goes through elements and their content until the end of the
+ * file or chunk. Returns 0 if it's something we can't handle. */
+static int ScanContent(struct Scanner* S)
+{
+	for (;;) {
+		const char* Text = S->Pos;
+		int HasRef = 0;
+
+		if (!ScanText(S, &HasRef))
+			return 0;
+		if (S->Depth == 0 && !S->Chunk) {
+			/* Nothing but whitespace outside the root element */
+			for (; Text < S->Pos; Text++) {
+				if (!IsSpace(*Text))
+					return 0;
+			}
+		}
+		if (S->Pos >= S->End)
+			break;
+
+		if (S->Capture) {
+			/* The text must be all there is in the element
+			 * for it to be exactly what libxml would give. */
+			if (HasRef || S->End - S->Pos < 2 || S->Pos[1] != '/')
+				return 0;
+			if (S->Pos > Text) {
+				S->Capture->Start = Text;
+				S->Capture->Len = S->Pos - Text;
+			}
+			S->Capture = NULL;
+		}
+
+		if (S->End - S->Pos < 2) {
+			return 0;
+		} else if (S->Pos[1] == '/') {
+			if (!ScanEndTag(S))
+				return 0;
+		} else if (S->End - S->Pos >= 4 && memcmp(S->Pos, "<!--", 4) == 0) {
+			if (!ScanComment(S))
+				return 0;
+		} else if (S->End - S->Pos >= 9 && memcmp(S->Pos, "<![CDATA[", 9) == 0) {
+			/* Only in elements we don't take anything from */
+			if ((S->Depth == 0 && !S->Chunk) || !ScanCData(S))
+				return 0;
+		} else if (S->Pos[1] == '?') {
+			return 0;
+		} else {
+			/* Only one root element is allowed */
+			if (S->Depth == 0 && S->SeenRoot)
+				return 0;
+			if (!S->Chunk)
+				S->SeenRoot = 1;
+			if (!ScanStartTag(S))
+				return 0;
+		}
+	}
+	return 1;
+}
+
+/* Checks that there's nothing but whitespace and comments
+ * from Pos to the end of the file. */
+static int ScanEpilogue(struct Scanner* S, const char* Pos, const char* End)
+{
+	S->Pos = Pos;
+	S->End = End;
+	for (;;) {
+		SkipSpace(S);
+		if (S->Pos >= S->End)
+			return 1;
+		if (S->End - S->Pos < 4 || memcmp(S->Pos, "<!--", 4) != 0 ||
+		    !ScanComment(S))
+			return 0;
+	}
+}
+
+/* Adds the chunk in Next to the end of the document scanned so far in
+ * Doc, after checking that what the chunk assumed about the part of the
+ * file before it was right. */
+static int JoinChunk(struct Scanner* Doc, struct Scanner* Next, const char* End)
+{
+	int i, j, k;
+
+	/* Each chunk starts at a trkpt tag directly inside a trkseg */
+	if (Doc->Depth == 0 || Doc->InPoint || Doc->Capture ||
+	    !SpanIs(Doc->Stack[Doc->Depth - 1].Local, "trkseg"))
+		return 0;
+
+	for (i = 0; i < Next->NumNeeds; i++) {
+		struct Need* N = &Next->Needs[i];
+		if (N->Closes) {
+			if (Doc->Depth == 0 ||
+			    !SpanEqual(N->Name, Doc->Stack[Doc->Depth - 1].Name))
+				return 0;
+			Doc->NumPrefixes = Doc->Stack[--Doc->Depth].Prefixes;
+			/* After the root element, there can only be comments */
+			if (Doc->Depth == 0 && !ScanEpilogue(Doc, N->After, End))
+				return 0;
+		} else {
+			for (k = 0; k < Doc->NumPrefixes; k++) {
+				if (SpanEqual(Doc->Prefixes[k], N->Name))
+					break;
+			}
+			if (k == Doc->NumPrefixes)
+				return 0;
+		}
+	}
+
+	if (!AppendTrack(&Doc->Points, &Next->Points, Next->MarkBefore)) {
+		fprintf(stderr, _("Out of memory.\n"));
+		abort();
+	}
+
+	/* Carry on inside whatever the chunk left open */
+	for (j = 0; j < Next->Depth; j++) {
+		int From = Next->Stack[j].Prefixes;
+		int To = (j + 1 < Next->Depth) ? Next->Stack[j + 1].Prefixes : Next->NumPrefixes;
+		if (Doc->Depth >= MAX_DEPTH || Doc->NumPrefixes + To - From > MAX_PREFIXES)
+			return 0;
+		Doc->Stack[Doc->Depth] = Next->Stack[j];
+		Doc->Stack[Doc->Depth].Prefixes = Doc->NumPrefixes;
+		Doc->Depth++;
+		for (k = From; k < To; k++)
+			Doc->Prefixes[Doc->NumPrefixes++] = Next->Prefixes[k];
+	}
+	Doc->InPoint = Next->InPoint;
+	Doc->Capture = Next->Capture;
+	return 1;
+}
+
+static void* ScanChunk(void* Arg)
+{
+	struct Scanner* S = (struct Scanner*) Arg;
+	S->Ok = ScanContent(S);
+	return NULL;
+}
+
+/* Finds the next trkpt tag at or after p. */
+static const char* FindPoint(const char* p, const char* End)
+{
+	while (p < End && (p = (const char*) memchr(p, '<', End - p)) != NULL) {
+		if (End - p > 6 && memcmp(p + 1, "trkpt", 5) == 0 && !IsNameChar(p[6]))
+			return p;
+		p++;
+	}
+	return NULL;
+}
+
+/* Scans the whole document, splitting it up into chunks to be done in
+ * parallel if it's big enough. Returns 0 if it isn't one we can handle. */
+static int ScanDocument(struct Scanner* Doc, const char* Start, const char* End)
+{
+	const char* Bounds[MAX_CHUNKS + 1];
+	struct Scanner* Chunks = NULL;
+	int NumChunks = 1;
+	int i, Ok;
+
+	memset(Doc, 0, sizeof(*Doc));
+	Doc->Pos = Start;
+	Doc->End = End;
+	if (!ScanProlog(Doc))
+		return 0;
+
+	long CPUs = NumCPUs();
+	if (CPUs > 1 && (size_t)(End - Start) >= 2 * (size_t) MIN_CHUNK) {
+		long Wanted = (long)((End - Start) / MIN_CHUNK);
+		if (Wanted > CPUs)
+			Wanted = CPUs;
+		if (Wanted > MAX_CHUNKS)
+			Wanted = MAX_CHUNKS;
+
+		/* Split at trkpt tags, as near to evenly as we can */
+		Bounds[0] = Doc->Pos;
+		for (i = 1; i < Wanted; i++) {
+			const char* Split = Start + (End - Start) / Wanted * i;
+			if (Split <= Bounds[NumChunks - 1])
+				Split = Bounds[NumChunks - 1] + 1;
+			Split = FindPoint(Split, End);
+			if (Split == NULL)
+				break;
+			Bounds[NumChunks++] = Split;
+		}
+		Bounds[NumChunks] = End;
+	}
+
+	if (NumChunks > 1)
+		Chunks = (struct Scanner*) calloc(NumChunks, sizeof(*Chunks));
+	if (Chunks) {
+		pthread_t* Threads = (pthread_t*) calloc(NumChunks, sizeof(*Threads));
+		int* Started = (int*) calloc(NumChunks, sizeof(*Started));
+
+		for (i = 1; i < NumChunks; i++) {
+			Chunks[i].Pos = Bounds[i];
+			Chunks[i].End = Bounds[i + 1];
+			Chunks[i].Latin1 = Doc->Latin1;
+			Chunks[i].Chunk = 1;
+			if (Threads && Started)
+				Started[i] = pthread_create(&Threads[i], NULL, ScanChunk, &Chunks[i]) == 0;
+		}
+
+		/* The first chunk is done here, and any that couldn't get
+		 * a thread of their own. */
+		Doc->End = Bounds[1];
+		Ok = ScanContent(Doc);
+		for (i = 1; i < NumChunks; i++) {
+			if (Started && Started[i])
+				pthread_join(Threads[i], NULL);
+			else
+				ScanChunk(&Chunks[i]);
+		}
+		free(Threads);
+		free(Started);
+
+		/* Stitch them all together in order */
+		for (i = 1; i < NumChunks; i++) {
+			Ok = Ok && Chunks[i].Ok && JoinChunk(Doc, &Chunks[i], End);
+			FreeTrack(&Chunks[i].Points);
+			free(Chunks[i].Needs);
+		}
+		free(Chunks);
+		if (Ok && Doc->SeenRoot && Doc->Depth == 0)
+			return 1;
+
+		/* Something didn't line up, which generally means the file
+		 * isn't one we can handle anyway. But make sure by going
+		 * through it again from the start, all in one piece. */
+		FreeTrack(&Doc->Points);
+		memset(Doc, 0, sizeof(*Doc));
+		Doc->Pos = Start;
+		Doc->End = End;
+		if (!ScanProlog(Doc))
+			return 0;
+	}
+
+	Ok = ScanContent(Doc);
+	return Ok && Doc->SeenRoot && Doc->Depth == 0;
+}
+
+int ScanGPX(const char* File, struct GPSTrack* Track)
+{
+	struct Scanner S;
+	struct stat Info;
+	char* Map;
+	size_t Size;
+	int fd;
+	int Ok;
+
+	fd = open(File, O_RDONLY | O_BINARY);
+	if (fd < 0)
+		return 0;
+	if (fstat(fd, &Info) != 0 || !S_ISREG(Info.st_mode) || Info.st_size <= 0 ||
+	    (unsigned long long) Info.st_size > (size_t) -1) {
+		close(fd);
+		return 0;
+	}
+	Size = (size_t) Info.st_size;
+
+#ifdef _WIN32
+	/* There's no mmap here, so read it all in instead. */
+	Map = (char*) malloc(Size);
+	if (Map && read(fd, Map, Size) != (ssize_t) Size) {
+		free(Map);
+		Map = NULL;
+	}
+	close(fd);
+	if (Map == NULL)
+		return 0;
+#else
+	Map = (char*) mmap(NULL, Size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (Map == MAP_FAILED)
+		return 0;
+#ifdef MADV_SEQUENTIAL
+	madvise(Map, Size, MADV_SEQUENTIAL);
+#endif
+#endif
+
+	Ok = ScanDocument(&S, Map, Map + Size);
+
+#ifdef _WIN32
+	free(Map);
+#else
+	munmap(Map, Size);
+#endif
+
+	if (!Ok) {
+		/* Throw it all away and let libxml have a go */
+		FreeTrack(&S.Points);
+		return 0;
+	}
+
+	*Track = S.Points;
+	return 1;
+}
@@ -0,0 +1,31 @@
+/* gpx-scan.h
+ * This file contains the prototype for the fast GPX
+ * scanner in gpx-scan.c.
+ */
+
+/* Copyright 2026 the gpscorrelate authors.
+ *
+ * This file is part of gpscorrelate.
+ *
+ * gpscorrelate is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * gpscorrelate is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with gpscorrelate; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+struct GPSTrack;
+
+/* Reads the track points out of a plain GPX file without the help of
+ * libxml. Returns 1 and fills in the points of Track on success, or 0 if
+ * the file uses something the scanner doesn't handle (or can't be read at
+ * all), in which case the caller must fall back to the full XML parser. */
+int ScanGPX(const char* File, struct GPSTrack* Track);
@@ -46,6 +46,8 @@
 #include "gui.h"
 #include "exif-gps.h"
 #include "gpx-read.h"
+#include "track-load.h"
+#include "track-index.h"
 #include "correlate.h"
 
 /* Declare all our widgets. Global to this module. */
@@ -1251,6 +1253,30 @@ void SelectGPSButtonPress( GtkWidget *Widget, gpointer Data )
 		gtk_file_filter_set_name(GpxFilter, _("GPX files"));
 		gtk_file_chooser_add_filter(GTK_FILE_CHOOSER(GPSDataDialog), GpxFilter);
 	}
+	GtkFileFilter *NmeaFilter = gtk_file_filter_new();
+	if (NmeaFilter) {
+		gtk_file_filter_add_pattern(NmeaFilter, "*.[nN][mM][eE][aA]");
+		gtk_file_filter_set_name(NmeaFilter, _("NMEA logs"));
+		gtk_file_chooser_add_filter(GTK_FILE_CHOOSER(GPSDataDialog), NmeaFilter);
+	}
+	GtkFileFilter *FitFilter = gtk_file_filter_new();
+	if (FitFilter) {
+		gtk_file_filter_add_pattern(FitFilter, "*.[fF][iI][tT]");
+		gtk_file_filter_set_name(FitFilter, _("FIT files"));
+		gtk_file_chooser_add_filter(GTK_FILE_CHOOSER(GPSDataDialog), FitFilter);
+	}
+	GtkFileFilter *JsonFilter = gtk_file_filter_new();
+	if (JsonFilter) {
+		gtk_file_filter_add_pattern(JsonFilter, "*.[jJ][sS][oO][nN]");
+		gtk_file_filter_set_name(JsonFilter, _("Google location history"));
+		gtk_file_chooser_add_filter(GTK_FILE_CHOOSER(GPSDataDialog), JsonFilter);
+	}
+	GtkFileFilter *Mp4Filter = gtk_file_filter_new();
+	if (Mp4Filter) {
+		gtk_file_filter_add_pattern(Mp4Filter, "*.[mM][pP]4");
+		gtk_file_filter_set_name(Mp4Filter, _("GoPro videos"));
+		gtk_file_chooser_add_filter(GTK_FILE_CHOOSER(GPSDataDialog), Mp4Filter);
+	}
 	GtkFileFilter *AllFilter = gtk_file_filter_new();
 	if (AllFilter) {
 		gtk_file_filter_add_pattern(AllFilter, "*");
@@ -1290,48 +1316,49 @@ void SelectGPSButtonPress( GtkWidget *Widget, gpointer Data )
 		/* Process the result of the dialog... */
 		GSList* FileNames = gtk_file_chooser_get_filenames (GTK_FILE_CHOOSER(GPSDataDialog));
 		GSList* Run;
-		for (Run = FileNames; Run; Run = Run->next)
+		int NumFiles = g_slist_length(FileNames);
+		int i;
+
+		/* Make room for all the tracks, plus the end-of-array entry,
+		 * so they can all be read in at once. */
+		char** Files = (char**) malloc(sizeof(*Files)*(NumFiles+1));
+		GPSData = (struct GPSTrack*) realloc(GPSData, sizeof(*GPSData)*(NumFiles+1));
+		if (Files == NULL || GPSData == NULL) {
+			fprintf(stderr, _("Out of memory.\n"));
+			abort();
+		}
+		memset(GPSData, 0, sizeof(*GPSData)*(NumFiles+1));
+		for (i = 0, Run = FileNames; Run; Run = Run->next)
 		{
-			/* Read in the new data, but stop trying after the first failure. */
-			if (ReadOk)
-			{
-				if (FirstOrBadFileName == NULL)
-				{
-					/* If only one file is given, this is it */
-					FirstOrBadFileName = strdup((char *)Run->data);
-				}
-				else
-				{
-					/* If more than one file is given, say so */
-					free(FirstOrBadFileName);
-					/* This string must look like a file path */
-					FirstOrBadFileName = strdup(_(G_DIR_SEPARATOR_S "multiple files"));
-				}
+			Files[i++] = (char *)Run->data;
+		}
 
-				ReadOk = ReadGPX((char*)Run->data, &GPSData[NumTracks]);
-				if (ReadOk)
-				{
-					/* Make room for a new end-of-array entry */
-					++NumTracks;
-					GPSData = (struct GPSTrack*) realloc(GPSData, sizeof(*GPSData)*(NumTracks+1));
-					if (GPSData == NULL) {
-						fprintf(stderr, _("Out of memory.\n"));
-						abort();
-					}
-					memset(&GPSData[NumTracks], 0, sizeof(*GPSData));
-				} else
-				{
-					/* If a file could not be read, give the name */
-					free(FirstOrBadFileName);
-					FirstOrBadFileName = strdup((char *)Run->data);
-				}
-			}
+		/* Read in the new data, but stop after the first failure. */
+		NumTracks = ReadTracks(Files, NumFiles, GPSData, NULL);
+		ReadOk = (NumTracks == NumFiles);
+		if (!ReadOk)
+		{
+			/* If a file could not be read, give the name */
+			FirstOrBadFileName = strdup(Files[NumTracks]);
+		} else if (NumFiles == 1)
+		{
+			/* If only one file is given, this is it */
+			FirstOrBadFileName = strdup(Files[0]);
+		} else if (NumFiles > 1)
+		{
+			/* If more than one file is given, say so */
+			/* This string must look like a file path */
+			FirstOrBadFileName = strdup(_(G_DIR_SEPARATOR_S "multiple files"));
+		}
 
-			/* Free the memory passed to us. */
+		/* Free the memory passed to us. */
+		for (Run = FileNames; Run; Run = Run->next)
+		{
 			g_free(Run->data);
 		}
 
 		/* We're done with the list - free it. */
+		free(Files);
 		g_slist_free(FileNames);
 
 		/* Close the dialog now that we're done. */
@@ -1484,6 +1511,17 @@ void CorrelateButtonPress( GtkWidget *Widget, gpointer Data )
 	/* Store the GPS track */
 	Options.Track = GPSData;
 
+	/* Index it, so each photo can be looked up in it. */
+	struct TrackIndex Index;
+	if (!BuildTrackIndex(&Index, GPSData, Options.DoBetweenTrkSeg,
+			     Options.FeatherTime))
+	{
+		fprintf(stderr, _("Out of memory.\n"));
+		free(Options.Datum);
+		return;
+	}
+	Options.Index = &Index;
+
 	/* Walk through the list, correlating, and updating the screen. */
 	struct GUIPhotoList* Walk;
 	struct GPSPoint* Result;
@@ -1566,6 +1604,7 @@ void CorrelateButtonPress( GtkWidget *Widget, gpointer Data )
 		} /* End if Result */
 	} /* End for Walk the list ... */
 
+	FreeTrackIndex(&Index);
 	free(Options.Datum);
 }
 
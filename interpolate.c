@@ -0,0 +1,308 @@
+/* interpolate.c
+ * This file contains routines for working out the point for a photo
+ * taken between two points of a track, one photo at a time or many.
+ *
+ * The batch kernels use SSE2 or AVX2 where the CPU has them, picked when
+ * the program runs, to do several photos at once straight out of the
+ * arrays of the track. They do the same sums in the same order as the
+ * scalar code, and only where the scalar code does them in the same
+ * kind of registers, so every point comes out bit for bit the same.
+ */
+
+/* Copyright 2026 the gpscorrelate authors.
+ *
+ * This file is part of gpscorrelate.
+ *
+ * gpscorrelate is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * gpscorrelate is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with gpscorrelate; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <stdint.h>
+
+#include "gpsstructure.h"
+#include "interpolate.h"
+
+#define MIN(a,b) (((a)<(b))?(a):(b))
+
+/* The vector kernels are only built for 64 bit x86, where the scalar
+ * code does its sums in SSE2 registers as well (rather than with the
+ * extra precision of the x87), and are left out if the compiler may
+ * fuse a multiply and an add, which rounds differently. Windows doesn't
+ * keep the stack aligned well enough for AVX spills. */
+#if defined(__GNUC__) && defined(__x86_64__) && !defined(__FMA__)
+#define HAVE_SSE2_KERNEL
+#include <emmintrin.h>
+#ifndef _WIN32
+#define HAVE_AVX2_KERNEL
+#include <immintrin.h>
+#endif
+#endif
+
+void InterpolatePoint(const struct GPSTrack* Track, size_t First,
+		time_t PhotoTime, struct GPSPoint* Result)
+{
+	/* Interpolate between the two points. The first point
+	 * is First, the other the one after it. Results into Result. */
+	struct GPSPoint A, B;
+	GetTrackPoint(Track, First, &A);
+	GetTrackPoint(Track, First + 1, &B);
+
+	/* Calculate the "scale": a decimal giving the relative distance
+	 * in time between the two points. Ie, a number between 0 and 1 -
+	 * 0 is the first point, 1 is the next point, and 0.5 would be
+	 * half way. */
+	double Scale = (double)B.Time - (double)A.Time;
+	Scale = ((double)PhotoTime - (double)A.Time) / Scale;
+
+	/* Now calculate the Latitude. */
+	Result->Lat = A.Lat + ((B.Lat - A.Lat) * Scale);
+	Result->LatDecimals = MIN(A.LatDecimals, B.LatDecimals);
+
+	/* And the longitude. */
+	Result->Long = A.Long + ((B.Long - A.Long) * Scale);
+	Result->LongDecimals = MIN(A.LongDecimals, B.LongDecimals);
+
+	/* And the elevation. If elevation wasn't set, it should be zero with
+	 * a negative ElevDecimals, which will cause it to be dropped
+	 * when written. */
+	Result->Elev = A.Elev + ((B.Elev - A.Elev) * Scale);
+	Result->ElevDecimals = MIN(A.ElevDecimals, B.ElevDecimals);
+
+	/* The time is not interpolated, but matches photo. */
+	Result->Time = PhotoTime;
+
+	/* And that should have fixed us... */
+
+}
+
+#if defined(HAVE_SSE2_KERNEL) || defined(HAVE_AVX2_KERNEL)
+
+/* Times are turned into doubles in the vector registers by adding them
+ * to the bits of 1.5 * 2^52 and taking that away again as a double,
+ * which is exact for times less than 2^51 seconds either side of 1970.
+ * Photos with any time further out than that go through the scalar
+ * code instead. */
+#define TIME_MAGIC 0x4338000000000000LL
+#define TIME_HALF_RANGE ((int64_t) 1 << 51)
+
+/* Fills in all but the coordinates of the points of photos From to
+ * From + Count - 1, whose coordinates are already in the arrays. */
+static void StorePoints(const struct GPSTrack* Track, const size_t* First,
+		const time_t* Times, size_t From, size_t Count,
+		const double* Lat, const double* Long, const double* Elev,
+		struct GPSPoint* Results)
+{
+	size_t j;
+
+	for (j = 0; j < Count; j++)
+	{
+		size_t A = First[From + j];
+		struct GPSPoint* Result = &Results[From + j];
+
+		Result->Lat = Lat[j];
+		Result->LatDecimals = MIN(Track->LatDecimals[A],
+					  Track->LatDecimals[A + 1]);
+		Result->Long = Long[j];
+		Result->LongDecimals = MIN(Track->LongDecimals[A],
+					   Track->LongDecimals[A + 1]);
+		Result->Elev = Elev[j];
+		Result->ElevDecimals = MIN(Track->ElevDecimals[A],
+					   Track->ElevDecimals[A + 1]);
+		Result->Time = Times[From + j];
+	}
+}
+#endif
+
+#ifdef HAVE_SSE2_KERNEL
+static __m128d TimesToDoubleSSE2(__m128i Times)
+{
+	const __m128i Magic = _mm_set1_epi64x(TIME_MAGIC);
+
+	return _mm_sub_pd(_mm_castsi128_pd(_mm_add_epi64(Times, Magic)),
+			  _mm_castsi128_pd(Magic));
+}
+
+/* Returns nonzero if all the times are close enough to 1970 for
+ * TimesToDoubleSSE2. */
+static int TimesInRangeSSE2(__m128i Times)
+{
+	__m128i High = _mm_srli_epi64(
+		_mm_add_epi64(Times, _mm_set1_epi64x(TIME_HALF_RANGE)), 52);
+
+	return _mm_movemask_epi8(_mm_cmpeq_epi32(High, _mm_setzero_si128()))
+		== 0xFFFF;
+}
+
+/* Interpolates one coordinate of two photos, from the pairs of values
+ * at and after their first points. */
+static __m128d LerpSSE2(const double* Values, size_t A0, size_t A1,
+		__m128d Scale)
+{
+	__m128d P0 = _mm_loadu_pd(&Values[A0]);
+	__m128d P1 = _mm_loadu_pd(&Values[A1]);
+	__m128d A = _mm_unpacklo_pd(P0, P1);
+	__m128d B = _mm_unpackhi_pd(P0, P1);
+
+	return _mm_add_pd(A, _mm_mul_pd(_mm_sub_pd(B, A), Scale));
+}
+
+static void InterpolateSSE2(const struct GPSTrack* Track,
+		const size_t* First, const time_t* Times, size_t NumPhotos,
+		struct GPSPoint* Results)
+{
+	size_t i;
+
+	for (i = 0; i + 2 <= NumPhotos; i += 2)
+	{
+		size_t A0 = First[i];
+		size_t A1 = First[i + 1];
+		__m128i T0 = _mm_loadu_si128((const __m128i*) &Track->Time[A0]);
+		__m128i T1 = _mm_loadu_si128((const __m128i*) &Track->Time[A1]);
+		__m128i PhotoTimes = _mm_loadu_si128((const __m128i*) &Times[i]);
+		double Lat[2], Long[2], Elev[2];
+
+		if (!TimesInRangeSSE2(T0) || !TimesInRangeSSE2(T1) ||
+		    !TimesInRangeSSE2(PhotoTimes))
+		{
+			InterpolatePoint(Track, A0, Times[i], &Results[i]);
+			InterpolatePoint(Track, A1, Times[i + 1], &Results[i + 1]);
+			continue;
+		}
+
+		__m128d TA = TimesToDoubleSSE2(_mm_unpacklo_epi64(T0, T1));
+		__m128d TB = TimesToDoubleSSE2(_mm_unpackhi_epi64(T0, T1));
+		__m128d Scale = _mm_div_pd(
+			_mm_sub_pd(TimesToDoubleSSE2(PhotoTimes), TA),
+			_mm_sub_pd(TB, TA));
+
+		_mm_storeu_pd(Lat, LerpSSE2(Track->Lat, A0, A1, Scale));
+		_mm_storeu_pd(Long, LerpSSE2(Track->Long, A0, A1, Scale));
+		_mm_storeu_pd(Elev, LerpSSE2(Track->Elev, A0, A1, Scale));
+		StorePoints(Track, First, Times, i, 2, Lat, Long, Elev, Results);
+	}
+	for (; i < NumPhotos; i++)
+		InterpolatePoint(Track, First[i], Times[i], &Results[i]);
+}
+#endif
+
+#ifdef HAVE_AVX2_KERNEL
+__attribute__((target("avx2")))
+static __m256d TimesToDoubleAVX2(__m256i Times)
+{
+	const __m256i Magic = _mm256_set1_epi64x(TIME_MAGIC);
+
+	return _mm256_sub_pd(_mm256_castsi256_pd(_mm256_add_epi64(Times, Magic)),
+			     _mm256_castsi256_pd(Magic));
+}
+
+__attribute__((target("avx2")))
+static __m256d LerpAVX2(const double* Values, __m256i A, __m256i B,
+		__m256d Scale)
+{
+	__m256d VA = _mm256_i64gather_pd(Values, A, 8);
+	__m256d VB = _mm256_i64gather_pd(Values, B, 8);
+
+	return _mm256_add_pd(VA, _mm256_mul_pd(_mm256_sub_pd(VB, VA), Scale));
+}
+
+__attribute__((target("avx2")))
+static void InterpolateAVX2(const struct GPSTrack* Track,
+		const size_t* First, const time_t* Times, size_t NumPhotos,
+		struct GPSPoint* Results)
+{
+	const long long* TrackTimes = (const long long*) Track->Time;
+	const __m256i HalfRange = _mm256_set1_epi64x(TIME_HALF_RANGE);
+	size_t i;
+
+	for (i = 0; i + 4 <= NumPhotos; i += 4)
+	{
+		__m256i A = _mm256_loadu_si256((const __m256i*) &First[i]);
+		__m256i B = _mm256_add_epi64(A, _mm256_set1_epi64x(1));
+		__m256i TA = _mm256_i64gather_epi64(TrackTimes, A, 8);
+		__m256i TB = _mm256_i64gather_epi64(TrackTimes, B, 8);
+		__m256i PhotoTimes = _mm256_loadu_si256((const __m256i*) &Times[i]);
+		__m256i High;
+		double Lat[4], Long[4], Elev[4];
+
+		High = _mm256_or_si256(
+			_mm256_or_si256(_mm256_add_epi64(TA, HalfRange),
+					_mm256_add_epi64(TB, HalfRange)),
+			_mm256_add_epi64(PhotoTimes, HalfRange));
+		High = _mm256_srli_epi64(High, 52);
+		if (!_mm256_testz_si256(High, High))
+		{
+			size_t j;
+			for (j = i; j < i + 4; j++)
+				InterpolatePoint(Track, First[j], Times[j], &Results[j]);
+			continue;
+		}
+
+		__m256d TimeA = TimesToDoubleAVX2(TA);
+		__m256d Scale = _mm256_div_pd(
+			_mm256_sub_pd(TimesToDoubleAVX2(PhotoTimes), TimeA),
+			_mm256_sub_pd(TimesToDoubleAVX2(TB), TimeA));
+
+		_mm256_storeu_pd(Lat, LerpAVX2(Track->Lat, A, B, Scale));
+		_mm256_storeu_pd(Long, LerpAVX2(Track->Long, A, B, Scale));
+		_mm256_storeu_pd(Elev, LerpAVX2(Track->Elev, A, B, Scale));
+		StorePoints(Track, First, Times, i, 4, Lat, Long, Elev, Results);
+	}
+	for (; i < NumPhotos; i++)
+		InterpolatePoint(Track, First[i], Times[i], &Results[i]);
+}
+#endif
+
+int BestInterpolateKernel(void)
+{
+#ifdef HAVE_AVX2_KERNEL
+	if (__builtin_cpu_supports("avx2"))
+		return INTERPOLATE_AVX2;
+#endif
+#ifdef HAVE_SSE2_KERNEL
+	return INTERPOLATE_SSE2;
+#else
+	return INTERPOLATE_SCALAR;
+#endif
+}
+
+void InterpolatePoints(int Kernel, const struct GPSTrack* Track,
+		const size_t* First, const time_t* Times, size_t NumPhotos,
+		struct GPSPoint* Results)
+{
+	size_t i;
+
+	/* The kernels read the arrays of the track and take the times as
+	 * 64 bit integers, so a compact track has to go point by point. */
+	if (!Track->Compact && sizeof(time_t) == sizeof(int64_t) &&
+	    sizeof(size_t) == sizeof(int64_t))
+	{
+#ifdef HAVE_AVX2_KERNEL
+		if (Kernel == INTERPOLATE_AVX2 && __builtin_cpu_supports("avx2"))
+		{
+			InterpolateAVX2(Track, First, Times, NumPhotos, Results);
+			return;
+		}
+#endif
+#ifdef HAVE_SSE2_KERNEL
+		if (Kernel == INTERPOLATE_SSE2 || Kernel == INTERPOLATE_AVX2)
+		{
+			InterpolateSSE2(Track, First, Times, NumPhotos, Results);
+			return;
+		}
+#endif
+	}
+
+	for (i = 0; i < NumPhotos; i++)
+		InterpolatePoint(Track, First[i], Times[i], &Results[i]);
+}
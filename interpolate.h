@@ -0,0 +1,62 @@
+/* interpolate.h
+ * This file contains prototypes for the functions
+ * in interpolate.c.
+ */
+
+/* Copyright 2026 the gpscorrelate authors.
+ *
+ * This file is part of gpscorrelate.
+ *
+ * gpscorrelate is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * gpscorrelate is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with gpscorrelate; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <stddef.h>
+#include <time.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct GPSTrack;
+struct GPSPoint;
+
+/* The ways InterpolatePoints can do its work */
+#define INTERPOLATE_SCALAR 0	/* One photo at a time */
+#define INTERPOLATE_SSE2   1	/* Two photos at a time */
+#define INTERPOLATE_AVX2   2	/* Four photos at a time */
+
+/* Works out the point for a photo taken at PhotoTime, between point First
+ * of a track and the one after it, which must be later. The time is the
+ * photo's, and everything else is in proportion to how far between the
+ * two points it was taken. */
+void InterpolatePoint(const struct GPSTrack* Track, size_t First,
+		time_t PhotoTime, struct GPSPoint* Result);
+
+/* Returns the fastest of the INTERPOLATE_ kernels this machine can run. */
+int BestInterpolateKernel(void);
+
+/* Does InterpolatePoint for NumPhotos photos, photo i taken at Times[i]
+ * between point First[i] of the track and the one after it, putting the
+ * point into Results[i]. Kernel is one of the INTERPOLATE_ values; if
+ * this machine or build can't run it, the next fastest that it can is
+ * used instead. Every kernel gives exactly the same points as
+ * InterpolatePoint. */
+void InterpolatePoints(int Kernel, const struct GPSTrack* Track,
+		const size_t* First, const time_t* Times, size_t NumPhotos,
+		struct GPSPoint* Results);
+
+#ifdef __cplusplus
+}
+#endif
@@ -24,8 +24,10 @@
  * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
  */
 
+#include <ctype.h>
 #include <errno.h>
 #include <limits.h>
+#include <locale.h>
 #include <math.h>
 #include <stdlib.h>
 #include <string.h>
@@ -45,8 +47,6 @@ struct GPSPoint *NewGPSPoint(void) {
 		Point->Elev = 0;
 		Point->ElevDecimals = -1;	// default meaning no altitude was found
 		Point->Time = 0;
-		Point->EndOfSegment = 0;
-		Point->Next = NULL;
 	}
 	return Point;
 }
@@ -64,6 +64,169 @@ int NumDecimals(const char *Decimal)
 	return 0;
 }
 
+/* Powers of ten that can be represented exactly as doubles */
+static const double ExactPowers[] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+/* Returns the number of decimal places after the first "." from Dec on,
+   just like NumDecimals, but stopping at End unless it's NULL. */
+static int CountDecimals(const char *Dec, const char *End)
+{
+	int Decimals = 0;
+	while ((End ? Dec < End : *Dec != '\0') && *Dec != '.')
+		++Dec;
+	if ((End ? Dec < End : *Dec != '\0')) {
+		for (++Dec; (!End || Dec < End) && *Dec >= '0' && *Dec <= '9'; ++Dec)
+			++Decimals;
+	}
+	return Decimals;
+}
+
+/* Hands the number over to strtod, for anything ParseDecimal can't be
+   sure of getting exactly right itself. The number has to be copied
+   anyway to be sure strtod stops at End, so "." is replaced with the
+   decimal point of the current locale along the way. */
+static double SlowParseDecimal(const char *Decimal, const char *End)
+{
+	const char *Point = localeconv()->decimal_point;
+	size_t PointLen = strlen(Point);
+	char Buffer[128];
+	char *Copy = Buffer;
+	size_t Size = sizeof(Buffer);
+	size_t Len = 0;
+	const char *Pos;
+	double Value;
+
+	for (Pos = Decimal; (End ? Pos < End : *Pos != '\0'); ++Pos) {
+		/* Only what strtod could use in the "C" locale */
+		if (!isalnum((unsigned char) *Pos) && !strchr("+-.()_ \t\n\v\f\r", *Pos))
+			break;
+		if (Len + PointLen + 1 > Size) {
+			char *Bigger;
+			Size *= 2;
+			Bigger = (char *) realloc(Copy == Buffer ? NULL : Copy, Size);
+			if (!Bigger) {
+				if (Copy != Buffer)
+					free(Copy);
+				return 0;
+			}
+			if (Copy == Buffer)
+				memcpy(Bigger, Buffer, Len);
+			Copy = Bigger;
+		}
+		if (*Pos == '.') {
+			memcpy(Copy + Len, Point, PointLen);
+			Len += PointLen;
+		} else {
+			Copy[Len++] = *Pos;
+		}
+	}
+	Copy[Len] = '\0';
+
+	Value = strtod(Copy, NULL);
+	if (Copy != Buffer)
+		free(Copy);
+	return Value;
+}
+
+/* Reads a decimal number, ending at End or at the end of the string if End
+   is NULL. The result is exactly what atof would give in the "C" locale
+   (whatever the current locale), and *Decimals is set to what NumDecimals
+   would return for the same string, all in a single pass for the usual
+   kind of number. */
+double ParseDecimal(const char *Decimal, const char *End, int *Decimals)
+{
+	const char *Pos = Decimal;
+	unsigned long long Mantissa = 0;
+	int SigDigits = 0;	/* significant digits in Mantissa */
+	int Digits = 0;		/* all the digits before any exponent */
+	int Exponent = 0;
+	int Negative = 0;
+	int HavePoint = 0;
+	double Value;
+
+#define MORE (End ? Pos < End : *Pos != '\0')
+#define IS_DIGIT (MORE && *Pos >= '0' && *Pos <= '9')
+
+	*Decimals = 0;
+	while (MORE && (*Pos == ' ' || (*Pos >= '\t' && *Pos <= '\r')))
+		++Pos;
+	if (MORE && (*Pos == '-' || *Pos == '+'))
+		Negative = (*Pos++ == '-');
+
+	for (; IS_DIGIT; ++Pos, ++Digits) {
+		if (SigDigits || *Pos != '0') {
+			Mantissa = Mantissa * 10 + (*Pos - '0');
+			++SigDigits;
+		}
+	}
+	/* Hexadecimal numbers are left to strtod */
+	if (Digits == 1 && MORE && (*Pos == 'x' || *Pos == 'X') && Mantissa == 0)
+		goto slow;
+
+	if (MORE && *Pos == '.') {
+		HavePoint = 1;
+		for (++Pos; IS_DIGIT; ++Pos, ++Digits, ++*Decimals) {
+			if (SigDigits || *Pos != '0') {
+				Mantissa = Mantissa * 10 + (*Pos - '0');
+				++SigDigits;
+			}
+			--Exponent;
+		}
+	}
+	/* This also covers infinity and NaN */
+	if (!Digits || SigDigits > 19)
+		goto slow;
+
+	if (MORE && (*Pos == 'e' || *Pos == 'E')) {
+		const char *Start = Pos++;
+		int ExpNegative = 0;
+		int ExpValue = 0;
+		if (MORE && (*Pos == '-' || *Pos == '+'))
+			ExpNegative = (*Pos++ == '-');
+		if (!IS_DIGIT) {
+			/* Not an exponent after all */
+			Pos = Start;
+		} else {
+			for (; IS_DIGIT; ++Pos) {
+				if (ExpValue > 10000)
+					goto slow;
+				ExpValue = ExpValue * 10 + (*Pos - '0');
+			}
+			Exponent += ExpNegative ? -ExpValue : ExpValue;
+		}
+	}
+
+	if (!HavePoint)
+		*Decimals = CountDecimals(Pos, End);
+
+	if (Mantissa == 0) {
+		Value = 0;
+	} else if (Mantissa <= (1ULL << 53) && Exponent >= -22 && Exponent <= 22) {
+		/* Both numbers are exact, so the result is correctly rounded */
+		Value = (double) Mantissa;
+		if (Exponent < 0)
+			Value /= ExactPowers[-Exponent];
+		else
+			Value *= ExactPowers[Exponent];
+	} else if (Exponent == 0) {
+		/* Converting the integer rounds correctly by itself */
+		Value = (double) Mantissa;
+	} else {
+		goto slow;
+	}
+	return Negative ? -Value : Value;
+
+slow:
+	*Decimals = CountDecimals(Decimal, End);
+	return SlowParseDecimal(Decimal, End);
+
+#undef IS_DIGIT
+#undef MORE
+}
+
 /* Parses a human-readable latitude, longitude and optionally elevation in
    decimal form
    e.g. 12.3456 -123.45678 1234.56
@@ -77,25 +240,23 @@ static int ParseLatLongDecimal(const char *latlongstr, struct GPSPoint* point)
 	if (!str)
 		goto err;
 
-	errno = 0; /* set by strtod */
+	errno = 0; /* set by strtod, if ParseDecimal needs it */
 
 	/* Latitude */
 	num = strtok(str, DEC_DELIMS);
 	if (!str || !point || !num || strlen(num) != strspn(num, DEC_NUMS))
 		goto err;
-	point->Lat = strtod(num, NULL);
+	point->Lat = ParseDecimal(num, NULL, &point->LatDecimals);
 	if (errno || point->Lat > 90 || point->Lat < -90)
 		goto err;
-	point->LatDecimals = NumDecimals(num);
 
 	/* Longitude */
 	num = strtok(NULL, DEC_DELIMS);
 	if (!num || strlen(num) != strspn(num, DEC_NUMS))
 		goto err;
-	point->Long = strtod(num, NULL);
+	point->Long = ParseDecimal(num, NULL, &point->LongDecimals);
 	if (errno || point->Long > 180 || point->Long < -180)
 		goto err;
-	point->LongDecimals = NumDecimals(num);
 
 	/* Elevation */
 	num = strtok(NULL, DEC_DELIMS);
@@ -106,15 +267,12 @@ static int ParseLatLongDecimal(const char *latlongstr, struct GPSPoint* point)
 	} else if (strlen(num) != strspn(num, DEC_NUMS)) {
 		goto err;
 	} else {
-		point->Elev = strtod(num, NULL);
+		point->Elev = ParseDecimal(num, NULL, &point->ElevDecimals);
 		if (errno)
 			goto err;
-		point->ElevDecimals = NumDecimals(num);
 	}
 
 	point->Time = 0;
-	point->EndOfSegment = 0;
-	point->Next = NULL;
 	free(str);
 	return 1;
 
@@ -231,8 +389,6 @@ static int ParseLatLongDMS(const char *latlongstr, struct GPSPoint* point)
 		point->ElevDecimals = NumDecimals(endstr);
 	}
 	point->Time = 0;
-	point->EndOfSegment = 0;
-	point->Next = NULL;
 	free(str);
 	return 1;
 
@@ -252,22 +408,21 @@ int ParseLatLong(const char *latlongstr, struct GPSPoint* point)
 /* Make a track from a single point */
 int MakeTrackFromLatLong(const struct GPSPoint* latlong, struct GPSTrack* track)
 {
-	struct GPSPoint* p1 = NewGPSPoint();
-	struct GPSPoint* p2 = NewGPSPoint();
-	if (!p1 || !p2) {
-		free(p1);
-		free(p2);
+	struct GPSPoint p;
+
+	memcpy(&p, latlong, sizeof(p));
+	p.Time = 0;
+	if (!AddTrackPoint(track, &p)) {
+		FreeTrack(track);
 		return 0;
 	}
-	memcpy(p1, latlong, sizeof(*p1));
-	p1->Time = track->MinTime = 0;
-	p1->Next = p2;
-
-	memcpy(p2, latlong, sizeof(*p2));
-	p2->Time = track->MaxTime = INT_MAX;
-	p2->Next = NULL;
-	p2->EndOfSegment = 1;
+	p.Time = INT_MAX;
+	if (!AddTrackPoint(track, &p)) {
+		FreeTrack(track);
+		return 0;
+	}
+	EndTrackSegment(track);
 
-	track->Points = p1;
+	GetTrackRange(track);
 	return 1;
 }
@@ -4,4 +4,5 @@ struct GPSPoint *NewGPSPoint(void);
 int ParseLatLong(const char *latlongstr, struct GPSPoint* point);
 int MakeTrackFromLatLong(const struct GPSPoint* latlong, struct GPSTrack* track);
 int NumDecimals(const char *Decimal);
+double ParseDecimal(const char *Decimal, const char *End, int *Decimals);
 
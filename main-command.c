@@ -39,8 +39,13 @@
 #include "exif-gps.h"
 #include "unixtime.h"
 #include "gpx-read.h"
+#include "track-load.h"
+#include "track-cache.h"
+#include "photo-track.h"
 #include "latlong.h"
+#include "track-index.h"
 #include "correlate.h"
+#include "photo-pipeline.h"
 
 #define GPS_EXIT_WARNING 2
 
@@ -72,6 +77,11 @@ static const struct option program_options[] = {
 	{ "fix-datestamps", no_argument, 0, 'f'},
 	{ "degmins", no_argument, 0, 'p'},
 	{ "photooffset", required_argument, 0, 'O'},
+	{ "track-cache", no_argument, 0, 'C'},
+	{ "cache-dir", required_argument, 0, 'D'},
+	{ "gps-from-photos", required_argument, 0, 'P'},
+	{ "compact-tracks", no_argument, 0, 'K'},
+	{ "jobs", required_argument, 0, 'j'},
 	{ 0, 0, 0, 0 }
 };
 
@@ -89,6 +99,7 @@ static void PrintUsage(const char* ProgramName)
 	printf(_("Usage: %s [options] file.jpg ...\n"), ProgramName);
 	puts(  _("-g, --gps file.gpx       Specifies GPX file with GPS data"));
 	puts(  _("-l, --latlong LAT,LONG[,E] Specifies latitude/longitude/elevation directly"));
+	puts(  _("    --gps-from-photos DIR Use the positions in geotagged photos in DIR"));
 	puts(  _("-z, --timeadd +/-HH[:MM] Time to add to GPS data to make it match photos"));
 	puts(  _("-i, --no-interpolation   Disable interpolation between points; interpolation\n"
 	         "                         is linear, points rounded if disabled"));
@@ -105,6 +116,11 @@ static void PrintUsage(const char* ProgramName)
 	puts(  _("-f, --fix-datestamps     Fix broken GPS datestamps written with ver. < 1.5.2"));
 	puts(  _("    --degmins            Write location as DD MM.MM (was default before v1.5.3)"));
 	puts(  _("-O, --photooffset SECS   Offset added to photo time to make it match the GPS"));
+	puts(  _("    --track-cache        Cache GPS data next to each GPX file for faster reuse"));
+	puts(  _("    --cache-dir DIR      Cache GPS data in DIR for faster reuse"));
+	puts(  _("    --compact-tracks     Hold GPS data in less memory, to fewer decimal places"));
+	puts(  _("-j, --jobs N|auto        Read and write N photos at a time, or as many as\n"
+	         "                         the disks keep up with"));
 	puts(  _("-h, --help               Display this help message"));
 	puts(  _("-v, --verbose            Show more detailed output"));
 	puts(  _("-V, --version            Display version information"));
@@ -352,6 +368,241 @@ static int FixDatestamp(const char* File, int AdjustmentHours, int AdjustmentMin
 	return rc;
 }
 
+/* Make room for a new end-of-array entry in the list of tracks, and the
+ * list of files to read them from. */
+static void AddTrackEntry(struct GPSTrack** Track, char*** TrackFiles, int NumTracks)
+{
+	*Track = (struct GPSTrack*) realloc(*Track, sizeof(**Track)*(NumTracks+1));
+	*TrackFiles = (char**) realloc(*TrackFiles, sizeof(**TrackFiles)*(NumTracks+1));
+	if (!*Track || !*TrackFiles)
+	{
+		fprintf(stderr, _("Out of memory.\n"));
+		exit(EXIT_FAILURE);
+	}
+	memset(&(*Track)[NumTracks], 0, sizeof(**Track));
+	(*TrackFiles)[NumTracks] = NULL;
+}
+
+/* Let the user know which GPS data is being read. */
+static void ShowReadProgress(const char* File, int Done)
+{
+	(void) File;
+	if (Done)
+	{
+		printf("\n");
+	} else {
+		printf(_("Reading GPS Data..."));
+		fflush(stdout);
+	}
+}
+
+/* Totals of what happened to the photos being correlated */
+struct Tally {
+	int ShowDetails;
+	int MatchExact;
+	int MatchInter;
+	int MatchRound;
+	int NotMatched;
+	int WriteFail;
+	int TooFar;
+	int NoDate;
+	int GPSPresent;
+	int NumTimes;	/* Photos whose times could be matched */
+	int RuledOut;	/* How many of them the coverage map ruled out */
+};
+
+/* Shows what happened to a photo, and adds it to the totals. */
+static void ReportPhoto(const char* File, int HaveTime,
+		const struct CorrelateResult* Match, void* Data)
+{
+	struct Tally* T = (struct Tally*) Data;
+	const struct GPSPoint* Result = NULL;
+
+	if (HaveTime)
+	{
+		T->NumTimes++;
+		T->RuledOut += Match->RuledOut;
+	}
+	if (Match->Result == CORR_OK || Match->Result == CORR_INTERPOLATED ||
+	    Match->Result == CORR_ROUND || Match->Result == CORR_EXIFWRITEFAIL)
+		Result = &Match->Point;
+
+	/* Was result NULL? */
+	if (Result)
+	{
+		/* Result not null. But what did happen? */
+		if (Match->Result == CORR_OK)
+		{
+			T->MatchExact++;
+			if (T->ShowDetails)
+			{
+				printf(_("%s: Exact match: "), File);
+			} else {
+				printf(".");
+			}
+		}
+		if (Match->Result == CORR_INTERPOLATED)
+		{
+			T->MatchInter++;
+			if (T->ShowDetails)
+			{
+				printf(_("%s: Interpolated: "), File);
+			} else {
+				printf("/");
+			}
+		}
+		if (Match->Result == CORR_ROUND)
+		{
+			T->MatchRound++;
+			if (T->ShowDetails)
+			{
+				printf(_("%s: Rounded: "), File);
+			} else {
+				printf("<");
+			}
+		}
+		if (Match->Result == CORR_EXIFWRITEFAIL)
+		{
+			T->WriteFail++;
+			if (T->ShowDetails)
+			{
+				printf(_("%s: EXIF write failure: "), File);
+			} else {
+				printf("w");
+			}
+		}
+		if (T->ShowDetails)
+		{
+			/* Print out the "point". */
+			printf(_("Lat %f, Long %f, Elev "),
+				Result->Lat, Result->Long);
+			if (Result->ElevDecimals >=0)
+				printf("%.3f.\n", Result->Elev);
+			else
+				printf(_("(unknown).\n"));
+		}
+		/* Ok, that's all from this part... */
+	} else {
+		/* We got nothing back. One of a few errors. */
+		if (Match->Result == CORR_NOMATCH)
+		{
+			T->NotMatched++;
+			if (T->ShowDetails)
+			{
+				printf(_("%s: No match.\n"), File);
+			} else {
+				printf("-");
+			}
+		}
+		if (Match->Result == CORR_TOOFAR)
+		{
+			T->TooFar++;
+			if (T->ShowDetails)
+			{
+				printf(_("%s: Too far from nearest point.\n"), File);
+			} else {
+				printf("^");
+			}
+		}
+		if (Match->Result == CORR_NOEXIFINPUT)
+		{
+			T->NoDate++;
+			if (T->ShowDetails)
+			{
+				printf(_("%s: No EXIF date tag present.\n"), File);
+			} else {
+				printf("?");
+			}
+		}
+		if (Match->Result == CORR_GPSDATAEXISTS)
+		{
+			T->GPSPresent++;
+			if (T->ShowDetails)
+			{
+				printf(_("%s: GPS Data already present.\n"), File);
+			} else {
+				printf("!");
+			}
+		}
+		/* Handled all those errors, now... */
+	} /* End if Result. */
+
+	/* Display the character code immediately */
+	fflush(stdout);
+}
+
+/* Correlates the photos one after another. The times of as many as can
+ * be are read first, so they can be matched in one go through the tracks,
+ * then each one is written in turn. A photo given more than once starts
+ * another lot, so it's read after the one before has been written. */
+static void CorrelateInTurn(char** Files, int NumPhotos,
+		struct CorrelateOptions* Options, struct Tally* Tally)
+{
+	int Start;
+	int End;
+	int Photo;
+	int* SameAs = (int*) malloc((NumPhotos + 1) * sizeof(*SameAs));
+	int* PhotoResults = (int*) malloc(NumPhotos * sizeof(*PhotoResults));
+	int* TimeOf = (int*) malloc(NumPhotos * sizeof(*TimeOf));
+	time_t* PhotoTimes = (time_t*) malloc(NumPhotos * sizeof(*PhotoTimes));
+	struct CorrelateResult* TimeResults = (struct CorrelateResult*)
+		malloc(NumPhotos * sizeof(*TimeResults));
+	if (!SameAs || !PhotoResults || !TimeOf || !PhotoTimes || !TimeResults ||
+	    !FindSameNames(Files, NumPhotos, SameAs))
+	{
+		fprintf(stderr, _("Out of memory.\n"));
+		exit(EXIT_FAILURE);
+	}
+	for (Start = 0; Start < NumPhotos; Start = End)
+	{
+		int NumTimes = 0;
+		for (End = Start; End < NumPhotos && SameAs[End] < Start; End++)
+		{
+			if (ReadPhotoTime(Files[End], Options, &PhotoTimes[NumTimes]))
+			{
+				TimeOf[End] = NumTimes++;
+			} else {
+				TimeOf[End] = -1;
+				PhotoResults[End] = Options->Result;
+			}
+		}
+		if (!CorrelateTimes(PhotoTimes, NumTimes, Options, TimeResults))
+		{
+			fprintf(stderr, _("Out of memory.\n"));
+			exit(EXIT_FAILURE);
+		}
+
+		for (Photo = Start; Photo < End; Photo++)
+		{
+			char* File = Files[Photo];
+			struct CorrelateResult Match;
+			if (TimeOf[Photo] < 0)
+			{
+				Match.Result = PhotoResults[Photo];
+				Match.RuledOut = 0;
+			} else {
+				Match = TimeResults[TimeOf[Photo]];
+				if (Match.Result != CORR_NOMATCH && Match.Result != CORR_TOOFAR)
+				{
+					/* Write the data back into the Exif info. */
+					if (!WritePhotoPoint(File, &Match.Point, Options))
+						Match.Result = CORR_EXIFWRITEFAIL;
+				}
+			}
+			ReportPhoto(File, TimeOf[Photo] >= 0, &Match, Tally);
+
+			/* And, once we've got here, we've finished with that file.
+			 * We can now do the next one. Now wasn't that too easy? */
+
+		} /* End for each photo. */
+	}
+	free(SameAs);
+	free(PhotoResults);
+	free(TimeOf);
+	free(PhotoTimes);
+	free(TimeResults);
+}
+
 int main(int argc, char** argv)
 {
 	InitializeExiv2();
@@ -377,6 +628,8 @@ int main(int argc, char** argv)
 					 final entry of all 0 signals the end. */
 	int NumTracks = 0;	     /* Number of track structures at Track,
 					not including the terminating entry. */
+	char** TrackFiles = NULL;    /* GPX file to read into each entry of
+					Track, or NULL if it's already done. */
 	int HaveTimeAdjustment = 0;  /* Whether -z option was given. */
 	int TimeZoneHours = 0;       /* Integer version of the timezone. */
 	int TimeZoneMins = 0;
@@ -394,11 +647,13 @@ int main(int argc, char** argv)
 	int FixDatestamps = 0;
 	int DegMinSecs = 1;
 	int PhotoOffset = 0;
+	int Jobs = 1;                /* Photos to read and write at once. */
 	struct GPSPoint *LatLong = NULL;
 
 	/* Create the empty terminating array entry */
 	Track = (struct GPSTrack*) calloc(1, sizeof(*Track));
-	if (!Track)
+	TrackFiles = (char**) calloc(1, sizeof(*TrackFiles));
+	if (!Track || !TrackFiles)
 	{
 		fprintf(stderr, _("Out of memory.\n"));
 		exit(EXIT_FAILURE);
@@ -408,7 +663,7 @@ int main(int argc, char** argv)
 	{
 		/* Call getopt to do all the hard work
 		 * for us... */
-		c = getopt_long(argc, argv, "g:z:il:hvd:m:nsortxRMVfO:",
+		c = getopt_long(argc, argv, "g:z:il:hvd:m:nsortxRMVfO:j:",
 				program_options, 0);
 
 		if (c == -1) break;
@@ -418,30 +673,30 @@ int main(int argc, char** argv)
 		{
 			case 'g':
 				/* This parameter specifies the GPS data.
-				 * It or 'l' must be present at least once. */
+				 * It or 'l' must be present at least once.
+				 * The files are all read together once the
+				 * options have been parsed. */
 				if (optarg)
 				{
-					int HaveTrack;
-
-					/* Read the XML file into memory and extract the "points". */
-					printf(_("Reading GPS Data..."));
-					fflush(stdout);
-					HaveTrack = ReadGPX(optarg, &Track[NumTracks]);
-					printf("\n");
-					if (!HaveTrack)
-					{
-						exit(EXIT_FAILURE);
-					}
-
-					/* Make room for a new end-of-array entry */
+					TrackFiles[NumTracks] = optarg;
 					++NumTracks;
-					Track = (struct GPSTrack*) realloc(Track, sizeof(*Track)*(NumTracks+1));
-					if (!Track)
+					AddTrackEntry(&Track, &TrackFiles, NumTracks);
+				}
+				break;
+			case 'P':
+				/* This parameter specifies a directory of
+				 * photos whose positions make up the GPS
+				 * data. It's read along with the GPX files. */
+				if (optarg)
+				{
+					if (!IsPhotoDirectory(optarg))
 					{
-						fprintf(stderr, _("Out of memory.\n"));
+						fprintf(stderr, _("%s is not a directory.\n"), optarg);
 						exit(EXIT_FAILURE);
 					}
-					memset(&Track[NumTracks], 0, sizeof(*Track));
+					TrackFiles[NumTracks] = optarg;
+					++NumTracks;
+					AddTrackEntry(&Track, &TrackFiles, NumTracks);
 				}
 				break;
 			case 'l':
@@ -467,15 +722,8 @@ int main(int argc, char** argv)
 				free(LatLong);
 				LatLong = NULL;
 
-				/* Make room for a new end-of-array entry */
 				++NumTracks;
-				Track = (struct GPSTrack*) realloc(Track, sizeof(*Track)*(NumTracks+1));
-				if (!Track)
-				{
-					fprintf(stderr, _("Out of memory.\n"));
-					exit(EXIT_FAILURE);
-				}
-				memset(&Track[NumTracks], 0, sizeof(*Track));
+				AddTrackEntry(&Track, &TrackFiles, NumTracks);
 				break;
 
 			case 'z':
@@ -582,6 +830,40 @@ int main(int argc, char** argv)
 				/* Write in old DegMins format. */
 				DegMinSecs = 0;
 				break;
+			case 'C':
+				/* Keep a cache file next to each GPX file. */
+				SetTrackCache(NULL);
+				break;
+			case 'D':
+				/* Keep the cache files in the given directory. */
+				if (optarg)
+				{
+					SetTrackCache(optarg);
+				}
+				break;
+			case 'K':
+				/* Squeeze the tracks into less memory. */
+				SetCompactTracks(1);
+				break;
+			case 'j':
+				/* Read and write this many photos at once. */
+				if (optarg)
+				{
+					if (strcmp(optarg, "auto") == 0)
+					{
+						/* Find how many as we go. */
+						Jobs = PIPELINE_AUTO;
+						break;
+					}
+					Jobs = atoi(optarg);
+					if (Jobs < 1 || Jobs > MAX_PIPELINE_THREADS)
+					{
+						fprintf(stderr, _("The number of jobs must be from 1 to %d, or auto.\n"),
+							MAX_PIPELINE_THREADS);
+						exit(EXIT_FAILURE);
+					}
+				}
+				break;
 			case '?':
 				/* Unrecognised option. Or, missing argument. */
 				/* The user has already been informed, so just exit. */
@@ -594,6 +876,38 @@ int main(int argc, char** argv)
 		} /* End switch(c) */
 	} /* End While(1) */
 
+	/* The dates in any photos used as GPS data are taken to be in the
+	 * same time zone as those in the photos being correlated. */
+	if (HaveTimeAdjustment)
+	{
+		SetPhotoTrackZone(TimeZoneHours, TimeZoneMins);
+	}
+
+	/* Read the XML files into memory and extract the "points".
+	 * Give up if any one of them can't be read. */
+	if (ReadTracks(TrackFiles, NumTracks, Track, ShowReadProgress) < NumTracks)
+	{
+		exit(EXIT_FAILURE);
+	}
+
+	/* Say how much of each track was read, and what it takes to keep. */
+	if (ShowDetails)
+	{
+		int i;
+		for (i = 0; i < NumTracks; i++)
+		{
+			struct TrackStats Stats;
+			if (!TrackFiles[i])
+				continue;
+			GetTrackStats(&Track[i], &Stats);
+			printf(_("%s: %lu point(s) in %lu segment(s), %lu bytes.\n"),
+				TrackFiles[i], (unsigned long) Stats.Points,
+				(unsigned long) Stats.Segments, (unsigned long) Stats.Bytes);
+		}
+	}
+	free(TrackFiles);
+	TrackFiles = NULL;
+
 	/* Check to see if the user passed some files to work with. Not much
 	 * good if they didn't. */
 	if (optind < argc)
@@ -626,6 +940,7 @@ int main(int argc, char** argv)
 	Options.DegMinSecs    = DegMinSecs;
 	Options.PhotoOffset   = PhotoOffset;
 	Options.Track         = Track;
+	Options.Index         = NULL;
 
 	/* If we only wanted to display info on the passed photos, do so now. */
 	if (ShowOnlyDetails)
@@ -679,6 +994,19 @@ int main(int argc, char** argv)
 		exit(EXIT_FAILURE);
 	}
 
+	/* Index the tracks, so each photo can be looked up in them. */
+	struct TrackIndex Index;
+	if (!BuildTrackIndex(&Index, Track, DoBetweenTrackSegs, FeatherTime))
+	{
+		fprintf(stderr, _("Out of memory.\n"));
+		exit(EXIT_FAILURE);
+	}
+	Options.Index = &Index;
+	if (ShowDetails && Index.MayMatch)
+		printf(_("Coverage map: %lu minute(s), %lu bytes.\n"),
+		       (unsigned long) Index.NumMinutes,
+		       (unsigned long) Index.CoverageBytes);
+
 	/* Print a legend for the matching process.
 	 * If we're not being verbose. Otherwise, this would be pointless. */
 	if (!ShowDetails)
@@ -691,138 +1019,29 @@ int main(int argc, char** argv)
 	printf(_("\nCorrelate: "));
 	if (ShowDetails) printf("\n");
 
-	/* A few variables that we'll require later. */
-	struct GPSPoint* Result;
-	char* File;
 	/* Including stats on what happened. */
-	int MatchExact = 0;
-	int MatchInter = 0;
-	int MatchRound = 0;
-	int NotMatched = 0;
-	int WriteFail  = 0;
-	int TooFar     = 0;
-	int NoDate     = 0;
-	int GPSPresent = 0;
-
-	/* Now it is time to correlate the photos. Feed one in at a time, and
-	 * see what happens.*/
+	struct Tally Tally;
+	memset(&Tally, 0, sizeof(Tally));
+	Tally.ShowDetails = ShowDetails;
+
 	/* We already checked to make sure that files were passed on the
 	 * command line, so just go for it... */
 	/* printf("Remaining non-option arguments: %d.\n", argc - optind); */
-	while (optind < argc)
+	int NumPhotos = argc - optind;
+	struct PipelineJobs JobsUsed;
+	if (Jobs != 1)
 	{
-		File = argv[optind++];
-		/* Pass the file along to Correlate and see what happens. */
-		Result = CorrelatePhoto(File, &Options);
-
-		/* Was result NULL? */
-		if (Result)
+		/* Read and write the photos on other threads, matching
+		 * each one as soon as it's been read. */
+		if (!CorrelatePhotos(argv + optind, NumPhotos, &Options, Jobs,
+				     &JobsUsed, ReportPhoto, &Tally))
 		{
-			/* Result not null. But what did happen? */
-			if (Options.Result == CORR_OK)
-			{
-				MatchExact++;
-				if (ShowDetails)
-				{
-					printf(_("%s: Exact match: "), File);
-				} else {
-					printf(".");
-				}
-			}
-			if (Options.Result == CORR_INTERPOLATED)
-			{
-				MatchInter++;
-				if (ShowDetails)
-				{
-					printf(_("%s: Interpolated: "), File);
-				} else {
-					printf("/");
-				}
-			}
-			if (Options.Result == CORR_ROUND)
-			{
-				MatchRound++;
-				if (ShowDetails)
-				{
-					printf(_("%s: Rounded: "), File);
-				} else {
-					printf("<");
-				}
-			}
-			if (Options.Result == CORR_EXIFWRITEFAIL)
-			{
-				WriteFail++;
-				if (ShowDetails)
-				{
-					printf(_("%s: EXIF write failure: "), File);
-				} else {
-					printf("w");
-				}
-			}
-			if (ShowDetails)
-			{
-				/* Print out the "point". */
-				printf(_("Lat %f, Long %f, Elev "),
-					Result->Lat, Result->Long);
-				if (Result->ElevDecimals >=0)
-					printf("%.3f.\n", Result->Elev);
-				else
-					printf(_("(unknown).\n"));
-			}
-			free(Result);
-			/* Ok, that's all from this part... */
-		} else {
-			/* We got nothing back. One of a few errors. */
-			if (Options.Result == CORR_NOMATCH)
-			{
-				NotMatched++;
-				if (ShowDetails)
-				{
-					printf(_("%s: No match.\n"), File);
-				} else {
-					printf("-");
-				}
-			}
-			if (Options.Result == CORR_TOOFAR)
-			{
-				TooFar++;
-				if (ShowDetails)
-				{
-					printf(_("%s: Too far from nearest point.\n"), File);
-				} else {
-					printf("^");
-				}
-			}
-			if (Options.Result == CORR_NOEXIFINPUT)
-			{
-				NoDate++;
-				if (ShowDetails)
-				{
-					printf(_("%s: No EXIF date tag present.\n"), File);
-				} else {
-					printf("?");
-				}
-			}
-			if (Options.Result == CORR_GPSDATAEXISTS)
-			{
-				GPSPresent++;
-				if (ShowDetails)
-				{
-					printf(_("%s: GPS Data already present.\n"), File);
-				} else {
-					printf("!");
-				}
-			}
-			/* Handled all those errors, now... */
-		} /* End if Result. */
-
-		/* Display the character code immediately */
-		fflush(stdout);
-
-		/* And, once we've got here, we've finished with that file.
-		 * We can now do the next one. Now wasn't that too easy? */
-
-	} /* End while parse command line files. */
+			fprintf(stderr, _("Out of memory.\n"));
+			exit(EXIT_FAILURE);
+		}
+	} else {
+		CorrelateInTurn(argv + optind, NumPhotos, &Options, &Tally);
+	}
 
 	/* Right, so now we're done. That really wasn't that hard. Right? */
 
@@ -835,22 +1054,32 @@ int main(int argc, char** argv)
 	/* Print details of what happened. */
 	printf(_("\nCompleted correlation process.\n"));
 	if (ShowDetails)
+	{
 		/* This has to be shown at the end in case auto time zone
 		 * was used, since it isn't known before the first file
 		 * is processed. */
 		printf(_("Used time zone offset %d:%02d\n"),
 		       Options.TimeZoneHours, abs(Options.TimeZoneMins));
+		if (Index.MayMatch)
+			printf(_("Ruled out by coverage map: %d of %d photo(s).\n"),
+			       Tally.RuledOut, Tally.NumTimes);
+		if (Jobs == PIPELINE_AUTO)
+			printf(_("Photos read and written at once: %d (from %d to %d).\n"),
+			       JobsUsed.Last, JobsUsed.Lowest, JobsUsed.Highest);
+	}
 	printf(_("Matched: %5d (%d Exact, %d Interpolated, %d Rounded).\n"),
-			MatchExact + MatchInter + MatchRound,
-			MatchExact, MatchInter, MatchRound);
+			Tally.MatchExact + Tally.MatchInter + Tally.MatchRound,
+			Tally.MatchExact, Tally.MatchInter, Tally.MatchRound);
 	printf(_("Failed:  %5d (%d Not matched, %d Write failure, %d Too Far,\n"),
-			NotMatched + WriteFail + TooFar + NoDate + GPSPresent,
-			NotMatched, WriteFail, TooFar);
+			Tally.NotMatched + Tally.WriteFail + Tally.TooFar +
+			Tally.NoDate + Tally.GPSPresent,
+			Tally.NotMatched, Tally.WriteFail, Tally.TooFar);
 	printf(_("                %d No Date, %d GPS Already Present.)\n"),
-			NoDate, GPSPresent);
+			Tally.NoDate, Tally.GPSPresent);
 
 
 	/* Clean up! */
+	FreeTrackIndex(&Index);
 	while (NumTracks > 0)
 	{
 		--NumTracks;
@@ -859,12 +1088,12 @@ int main(int argc, char** argv)
 	free(Track);
 	free(Datum);
 
-	if (WriteFail)
+	if (Tally.WriteFail)
 		/* A write failure is considered serious */
 		return EXIT_FAILURE;
 
 	/* Other failures aren't necessarily bad, depending on the input,
 	 * so provide a different return code to distinguish them.
 	 */
-	return(NotMatched + TooFar + NoDate + GPSPresent ? GPS_EXIT_WARNING : EXIT_SUCCESS);
+	return(Tally.NotMatched + Tally.TooFar + Tally.NoDate + Tally.GPSPresent ? GPS_EXIT_WARNING : EXIT_SUCCESS);
 }
@@ -0,0 +1,445 @@
+/* nmea-read.c
+ * This file contains routines for reading the track from a log of
+ * NMEA 0183 sentences, as written by many GPS receivers and loggers.
+ *
+ * The position, date and time come from the RMC sentences, and the
+ * altitude from the GGA sentence for the same fix, whichever order the
+ * two come in. Sentences without a good checksum are skipped. When the
+ * receiver reports that it has lost its fix, the track segment ends, and
+ * a new one starts with the next good fix. The file is read a block at a
+ * time, so it can be any size, and may be compressed.
+ */
+
+/* Copyright 2026 the gpscorrelate authors.
+ *
+ * This file is part of gpscorrelate.
+ *
+ * gpscorrelate is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * gpscorrelate is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with gpscorrelate; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+
+#include "i18n.h"
+#include "nmea-read.h"
+#include "decompress.h"
+#include "track-load.h"
+#include "unixtime.h"
+#include "gpsstructure.h"
+#include "latlong.h"
+
+/* Size of the buffer the file is read into. No sentence is anywhere near
+ * this long; lines that are are skipped. */
+#define NMEA_BUFFER 65536
+
+/* Most fields in a sentence we need to look at */
+#define MAX_FIELDS 24
+
+/* A field of a sentence. It is NOT nul terminated. */
+struct Field {
+	const char* Start;
+	const char* End;
+};
+
+struct NMEAState {
+	struct GPSTrack Points;
+	long LastMillis;	/* Time of day of the last point, in ms */
+
+	/* The altitude from the latest GGA sentence */
+	int HaveAltitude;
+	long AltitudeMillis;	/* Time of day of the fix, in ms */
+	double Altitude;
+	int AltitudeDecimals;
+
+	long BadChecksums;
+};
+
+static int IsDigit(char c)
+{
+	return c >= '0' && c <= '9';
+}
+
+static int HexValue(char c)
+{
+	if (c >= '0' && c <= '9')
+		return c - '0';
+	if (c >= 'A' && c <= 'F')
+		return c - 'A' + 10;
+	if (c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	return -1;
+}
+
+/* Returns 1 if p points to something like "$GPRMC," */
+static int IsSentenceStart(const char* p, const char* End)
+{
+	int i;
+
+	if (End - p < 7 || *p != '$')
+		return 0;
+	for (i = 1; i < 6; i++)
+		if (!IsDigit(p[i]) && (p[i] < 'A' || p[i] > 'Z'))
+			return 0;
+	return p[6] == ',';
+}
+
+int IsNMEA(const char* Start, size_t Len)
+{
+	const char* End = Start + Len;
+	const char* p = Start;
+	const char* Line;
+
+	if (Len >= 3 && memcmp(p, "\xef\xbb\xbf", 3) == 0)
+		p += 3;
+	while (p < End && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n'))
+		p++;
+	if (IsSentenceStart(p, End))
+		return 1;
+
+	/* The log may start part way through a sentence */
+	Line = (const char*) memchr(p, '\n', End - p);
+	if (Line == NULL || memchr(p, '<', Line - p) != NULL)
+		return 0;
+	return IsSentenceStart(Line + 1, End);
+}
+
+/* Returns 1 if the field holds just the character c. */
+static int IsChar(const struct Field* F, char c)
+{
+	return F->End - F->Start == 1 && *F->Start == c;
+}
+
+/* Returns 1 if the field is a plain decimal number, such as -12.5 */
+static int IsNumber(const struct Field* F)
+{
+	const char* p = F->Start;
+	int Digits = 0;
+
+	if (p < F->End && *p == '-')
+		p++;
+	for (; p < F->End && IsDigit(*p); p++)
+		Digits++;
+	if (p < F->End && *p == '.')
+		for (p++; p < F->End && IsDigit(*p); p++)
+			Digits++;
+	return Digits > 0 && p == F->End;
+}
+
+/* Reads a time of day as hhmmss or hhmmss.sss, in ms since midnight */
+static int ReadTimeOfDay(const struct Field* F, long* Millis)
+{
+	const char* p = F->Start;
+	long Hour, Min, Sec;
+	long Frac = 0;
+	long Scale = 100;
+	int i;
+
+	if (F->End - p < 6)
+		return 0;
+	for (i = 0; i < 6; i++)
+		if (!IsDigit(p[i]))
+			return 0;
+	Hour = (p[0] - '0') * 10 + (p[1] - '0');
+	Min = (p[2] - '0') * 10 + (p[3] - '0');
+	Sec = (p[4] - '0') * 10 + (p[5] - '0');
+	p += 6;
+
+	if (p < F->End) {
+		if (*p++ != '.')
+			return 0;
+		for (; p < F->End && IsDigit(*p); p++) {
+			Frac += (*p - '0') * Scale;
+			Scale /= 10;
+		}
+		if (p != F->End)
+			return 0;
+	}
+	/* 60 seconds is a leap second */
+	if (Hour > 23 || Min > 59 || Sec > 60)
+		return 0;
+
+	*Millis = ((Hour * 60 + Min) * 60 + Sec) * 1000 + Frac;
+	return 1;
+}
+
+/* Reads a date as ddmmyy */
+static int ReadDate(const struct Field* F, long* Year, int* Month, long* Day)
+{
+	const char* p = F->Start;
+	int i;
+
+	if (F->End - p != 6)
+		return 0;
+	for (i = 0; i < 6; i++)
+		if (!IsDigit(p[i]))
+			return 0;
+	*Day = (p[0] - '0') * 10 + (p[1] - '0');
+	*Month = (p[2] - '0') * 10 + (p[3] - '0');
+	*Year = (p[4] - '0') * 10 + (p[5] - '0');
+	/* NMEA was around long before 1980, but not GPS loggers */
+	*Year += *Year < 80 ? 2000 : 1900;
+	return *Month >= 1 && *Month <= 12 && *Day >= 1 && *Day <= 31;
+}
+
+/* Reads a latitude or longitude given as degrees and minutes (ddmm.mmmm
+ * or dddmm.mmmm), followed by a field giving the hemisphere. */
+static int ReadCoordinate(const struct Field* F, const struct Field* Hemisphere,
+		char Positive, char Negative, int MaxDegrees,
+		double* Value, int* Decimals)
+{
+	const char* Dot;
+	const char* p;
+	long Degrees = 0;
+	double Minutes;
+	int MinuteDecimals;
+
+	if (!IsNumber(F) || *F->Start == '-')
+		return 0;
+	if (!IsChar(Hemisphere, Positive) && !IsChar(Hemisphere, Negative))
+		return 0;
+	Dot = (const char*) memchr(F->Start, '.', F->End - F->Start);
+	if (Dot == NULL)
+		Dot = F->End;
+	/* The minutes are the two digits before the decimal point */
+	if (Dot - F->Start < 3 || Dot - F->Start > 5)
+		return 0;
+
+	for (p = F->Start; p < Dot - 2; p++)
+		Degrees = Degrees * 10 + (*p - '0');
+	Minutes = ParseDecimal(Dot - 2, F->End, &MinuteDecimals);
+	if (Degrees > MaxDegrees || Minutes >= 60.0)
+		return 0;
+
+	*Value = Degrees + Minutes / 60.0;
+	if (IsChar(Hemisphere, Negative))
+		*Value = -*Value;
+	/* A minute is a bit under two decimal places of a degree */
+	*Decimals = MinuteDecimals + 2;
+	return 1;
+}
+
+/* Ends the track segment, as the receiver has lost its fix. */
+static void FixLost(struct NMEAState* S)
+{
+	EndTrackSegment(&S->Points);
+}
+
+/* Recommended minimum data: time, status, position and date */
+static void ReadRMC(struct NMEAState* S, const struct Field* F, int NumFields)
+{
+	struct GPSPoint Point;
+	size_t Last = S->Points.NumPoints;
+	double Lat, Long;
+	int LatDecimals, LongDecimals;
+	long Millis;
+	long Year, Day;
+	int Month;
+	time_t Time;
+
+	if (NumFields < 10 || !ReadTimeOfDay(&F[1], &Millis))
+		return;
+	/* From NMEA 2.3, there's also a mode, which is N with no fix */
+	if (!IsChar(&F[2], 'A') || (NumFields > 12 && IsChar(&F[12], 'N'))) {
+		FixLost(S);
+		return;
+	}
+	if (!ReadCoordinate(&F[3], &F[4], 'N', 'S', 90, &Lat, &LatDecimals) ||
+	    !ReadCoordinate(&F[5], &F[6], 'E', 'W', 180, &Long, &LongDecimals) ||
+	    !ReadDate(&F[9], &Year, &Month, &Day))
+		return;
+
+	/* Fractions of a second are dropped, as for GPX files */
+	Time = UTCToUnixTime(Year, Month, Day, 0, 0, Millis / 1000);
+
+	/* Receivers with more than one system may give the same fix more
+	 * than once, such as from both GP and GN talkers. */
+	if (Last && S->Points.Time[Last - 1] == Time && S->LastMillis == Millis)
+		return;
+
+	Point.Lat = Lat;
+	Point.LatDecimals = LatDecimals;
+	Point.Long = Long;
+	Point.LongDecimals = LongDecimals;
+	Point.Time = Time;
+	if (S->HaveAltitude && S->AltitudeMillis == Millis) {
+		Point.Elev = S->Altitude;
+		Point.ElevDecimals = S->AltitudeDecimals;
+	} else {
+		Point.Elev = 0;
+		Point.ElevDecimals = -1;
+	}
+
+	if (!AddTrackPoint(&S->Points, &Point)) {
+		fprintf(stderr, _("Out of memory.\n"));
+		abort();
+	}
+	S->LastMillis = Millis;
+}
+
+/* Fix data: time, position, fix quality and altitude */
+static void ReadGGA(struct NMEAState* S, const struct Field* F, int NumFields)
+{
+	size_t Last = S->Points.NumPoints;
+	long Millis;
+
+	if (NumFields < 10 || !ReadTimeOfDay(&F[1], &Millis))
+		return;
+	if (F[6].Start == F[6].End || IsChar(&F[6], '0')) {
+		FixLost(S);
+		return;
+	}
+	if (!IsNumber(&F[9])) {
+		S->HaveAltitude = 0;
+		return;
+	}
+
+	S->HaveAltitude = 1;
+	S->AltitudeMillis = Millis;
+	S->Altitude = ParseDecimal(F[9].Start, F[9].End, &S->AltitudeDecimals);
+
+	/* The RMC sentence for this fix may have come first */
+	if (Last && S->LastMillis == Millis && S->Points.ElevDecimals[Last - 1] < 0) {
+		S->Points.Elev[Last - 1] = S->Altitude;
+		S->Points.ElevDecimals[Last - 1] = (signed char)
+			(S->AltitudeDecimals > SCHAR_MAX ? SCHAR_MAX : S->AltitudeDecimals);
+	}
+}
+
+/* Reads one line of the file. */
+static void ReadSentence(struct NMEAState* S, const char* Line, const char* End)
+{
+	struct Field F[MAX_FIELDS];
+	const char* p;
+	unsigned Sum = 0;
+	int NumFields;
+	int High, Low;
+
+	/* Some loggers put something of their own before each sentence */
+	Line = (const char*) memchr(Line, '$', End - Line);
+	if (Line == NULL)
+		return;
+	while (End > Line && (End[-1] == '\r' || End[-1] == ' ' || End[-1] == '\t'))
+		End--;
+
+	if (End - Line < 4 || End[-3] != '*' ||
+	    (High = HexValue(End[-2])) < 0 || (Low = HexValue(End[-1])) < 0) {
+		S->BadChecksums++;
+		return;
+	}
+	End -= 3;
+	for (p = Line + 1; p < End; p++)
+		Sum ^= (unsigned char) *p;
+	if (Sum != (unsigned) (High * 16 + Low)) {
+		S->BadChecksums++;
+		return;
+	}
+
+	NumFields = 0;
+	F[0].Start = Line + 1;
+	for (p = Line + 1; p < End && NumFields < MAX_FIELDS - 1; p++) {
+		if (*p == ',') {
+			F[NumFields++].End = p;
+			F[NumFields].Start = p + 1;
+		}
+	}
+	F[NumFields++].End = End;
+
+	/* The talker is two letters, then comes the sentence type.
+	 * Proprietary sentences start with P and are ignored. */
+	if (F[0].End - F[0].Start != 5 || *F[0].Start == 'P')
+		return;
+	if (memcmp(F[0].Start + 2, "RMC", 3) == 0)
+		ReadRMC(S, F, NumFields);
+	else if (memcmp(F[0].Start + 2, "GGA", 3) == 0)
+		ReadGGA(S, F, NumFields);
+}
+
+int ReadNMEA(const char* File, struct GPSTrack* Track)
+{
+	struct NMEAState S;
+	struct Decompressor* In;
+	char* Buffer;
+	const char* Start;
+	const char* Newline;
+	size_t Len = 0;
+	int Skipping = 0;	/* In a line too long to be a sentence */
+	int Ok = 1;
+	int Got;
+
+	memset(&S, 0, sizeof(S));
+
+	In = OpenDecompressed(File);
+	Buffer = (char*) malloc(NMEA_BUFFER);
+	if (In == NULL || Buffer == NULL) {
+		TrackReadError(_("Failed to read NMEA data from %s.\n"), File);
+		free(Buffer);
+		CloseCompressed(In);
+		return 0;
+	}
+
+	for (;;) {
+		Got = ReadCompressed(In, Buffer + Len, (int) (NMEA_BUFFER - Len));
+		if (Got < 0) {
+			Ok = 0;
+			break;
+		}
+		Len += Got;
+
+		/* Read each complete line */
+		Start = Buffer;
+		while ((Newline = (const char*) memchr(Start, '\n', Buffer + Len - Start)) != NULL) {
+			if (!Skipping)
+				ReadSentence(&S, Start, Newline);
+			Skipping = 0;
+			Start = Newline + 1;
+		}
+
+		if (Got == 0) {
+			/* The last line needn't end in a newline */
+			if (!Skipping && Start < Buffer + Len)
+				ReadSentence(&S, Start, Buffer + Len);
+			break;
+		}
+
+		/* Keep the start of the next line for next time */
+		Len = Buffer + Len - Start;
+		if (Len == NMEA_BUFFER) {
+			Skipping = 1;
+			Len = 0;
+		} else {
+			memmove(Buffer, Start, Len);
+		}
+	}
+
+	free(Buffer);
+	CloseCompressed(In);
+
+	if (!Ok) {
+		FreeTrack(&S.Points);
+		return 0;
+	}
+
+	if (S.BadChecksums)
+		TrackReadError(_("Warning: skipped %ld NMEA sentence(s) with bad checksums in %s.\n"),
+			S.BadChecksums, File);
+
+	/* The end of the log is the end of a segment, too */
+	EndTrackSegment(&S.Points);
+	*Track = S.Points;
+	GetTrackRange(Track);
+	return 1;
+}
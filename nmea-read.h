@@ -0,0 +1,34 @@
+/* nmea-read.h
+ * This file contains prototypes for the functions
+ * in nmea-read.c.
+ */
+
+/* Copyright 2026 the gpscorrelate authors.
+ *
+ * This file is part of gpscorrelate.
+ *
+ * gpscorrelate is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * gpscorrelate is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with gpscorrelate; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <stddef.h>
+
+struct GPSTrack;
+
+/* Returns 1 if the start of a file looks like an NMEA 0183 log. */
+int IsNMEA(const char* Start, size_t Len);
+
+/* Reads the track from an NMEA 0183 log, which may be compressed.
+ * Returns 1 on success or 0 if the file can't be read. */
+int ReadNMEA(const char* File, struct GPSTrack* Track);
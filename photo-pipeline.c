@@ -0,0 +1,475 @@
+/* photo-pipeline.c
+ * This file contains routines for correlating many photos at once,
+ * with a pool of threads reading the dates from the photos and writing
+ * the points back into them while the calling thread matches them up.
+ *
+ * Each photo goes through the stages in turn: read by a worker, matched
+ * by the calling thread in the order the photos were given (so the time
+ * zone is taken from the same photo as it would be otherwise), written
+ * by a worker, and finally handed back, again in order. Workers take on
+ * writes before reads, so photos don't pile up waiting to be written,
+ * and reads are held back once a few photos per thread are in hand.
+ *
+ * When asked to, the number of reads and writes going on at once is
+ * found as it goes rather than fixed. The reads and writes are timed,
+ * and after every few of them the number allowed is raised, so long as
+ * the last raise made them go faster. It's doubled to start with, then
+ * raised by one at a time. When a raise doesn't help, the disk or network
+ * share can't keep up with any more, so the number is cut by a quarter
+ * and then raised again from there. It's also cut if they start taking
+ * much longer each, such as when the photos move on to a slower disk.
+ * Those started before a change are left out of the timings, so they
+ * only show how fast it goes with the number now allowed.
+ */
+
+/* Copyright 2026 the gpscorrelate authors.
+ *
+ * This file is part of gpscorrelate.
+ *
+ * gpscorrelate is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * gpscorrelate is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with gpscorrelate; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "gpsstructure.h"
+#include "exif-gps.h"
+#include "correlate.h"
+#include "photo-pipeline.h"
+
+/* Photos in hand at once, for each thread */
+#define SLOTS_PER_THREAD 4
+
+/* Reads and writes allowed at once to start with, when finding it */
+#define AUTO_START_JOBS 2
+
+/* Fewest reads and writes timed before changing the number allowed */
+#define AUTO_MIN_WINDOW 8
+
+/* Raising the number allowed from M to N could at best make them go N / M
+ * times as fast, or at worst make each take N / M times as long. If they
+ * go less than this part of the best faster and take more than this part
+ * of the worst longer, the disk is taken to be as busy as it can be. */
+#define AUTO_MIN_GAIN 0.5
+
+/* The number allowed is cut if each read or write takes this many times
+ * as long as before with the same number allowed */
+#define AUTO_SLOWER 1.5
+
+/* Where a photo is in the pipeline */
+#define SLOT_FREE     0		/* Not read yet, or handed back */
+#define SLOT_READING  1
+#define SLOT_READ     2		/* Waiting to be matched */
+#define SLOT_WRITE    3		/* Waiting to be written */
+#define SLOT_WRITING  4
+#define SLOT_DONE     5		/* Waiting to be handed back */
+
+struct Slot {
+	int State;
+	char* Date;		/* From ReadExifDate */
+	int IncludesGPS;
+	int HaveTime;
+	struct CorrelateResult Match;
+};
+
+struct Pipeline {
+	char* const* Files;
+	int NumFiles;
+	const struct CorrelateOptions* Options;
+	int* SameAs;		/* Last photo before each with the same name, or -1 */
+
+	/* Photo i is in Slots[i % NumSlots] from when it's read until it's
+	 * handed back. Photos before Printed have been handed back, and
+	 * those from Printed up to Matched have been matched. */
+	struct Slot* Slots;
+	int NumSlots;
+	int NextRead;
+	int Matched;
+	int Printed;
+	int Writes;		/* Photos waiting to be written */
+	int Stop;
+
+	/* Reads and writes allowed at once, and going on */
+	int Limit;
+	int InFlight;
+
+	/* For finding Limit as it goes */
+	int Auto;
+	int MaxLimit;
+	int Limited;		/* As many were going on as Limit allows */
+	int SlowStart;		/* Doubling Limit, until it's first cut */
+	int Settling;		/* Limit was just changed */
+	int LastStep;		/* Limit was last raised (1), cut (-1) or kept (0) */
+	int LastLimit;		/* Limit before */
+	int WindowOps;
+	double WindowStart;
+	double WindowLatency;
+	double LastRate;	/* Reads and writes a second, before */
+	double LastLatency;	/* Average seconds each, before */
+	struct PipelineJobs* Jobs;
+
+	pthread_mutex_t Lock;
+	pthread_cond_t Work;	/* Signalled when there may be work to do */
+	pthread_cond_t Progress; /* Signalled when a photo moves on */
+};
+
+#define SLOT(P, i) (&(P)->Slots[(i) % (P)->NumSlots])
+
+/* A photo's name, for finding the ones given more than once */
+struct NamedPhoto {
+	const char* Name;
+	int Index;
+};
+
+static int CompareNames(const void* A, const void* B)
+{
+	const struct NamedPhoto* PA = (const struct NamedPhoto*) A;
+	const struct NamedPhoto* PB = (const struct NamedPhoto*) B;
+	int Diff = strcmp(PA->Name, PB->Name);
+
+	if (Diff)
+		return Diff;
+	return PA->Index - PB->Index;
+}
+
+int FindSameNames(char* const* Files, int NumFiles, int* SameAs)
+{
+	struct NamedPhoto* Named = (struct NamedPhoto*)
+		malloc((NumFiles + 1) * sizeof(*Named));
+	int i;
+
+	if (!Named)
+		return 0;
+	for (i = 0; i < NumFiles; i++)
+	{
+		Named[i].Name = Files[i];
+		Named[i].Index = i;
+		SameAs[i] = -1;
+	}
+	qsort(Named, NumFiles, sizeof(*Named), CompareNames);
+	for (i = 1; i < NumFiles; i++)
+		if (!strcmp(Named[i].Name, Named[i - 1].Name))
+			SameAs[Named[i].Index] = Named[i - 1].Index;
+	free(Named);
+	return 1;
+}
+
+/* Returns a time in seconds, for timing reads and writes */
+static double Now(void)
+{
+#ifdef CLOCK_MONOTONIC
+	struct timespec Time;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &Time) == 0)
+		return Time.tv_sec + Time.tv_nsec / 1e9;
+#endif
+	return (double) time(NULL);
+}
+
+/* Adds a read or write that took Latency seconds to the ones timed so
+ * far and, after enough of them, moves Limit up or down. Called with the
+ * lock held. */
+static void TimedWork(struct Pipeline* P, double Latency)
+{
+	double Elapsed, Rate, Mean;
+	int Window = 4 * P->Limit;
+	int Step = 0;
+
+	P->WindowOps++;
+	P->WindowLatency += Latency;
+	if (Window < AUTO_MIN_WINDOW)
+		Window = AUTO_MIN_WINDOW;
+	if (!P->Auto || P->WindowOps < Window)
+		return;
+
+	Elapsed = Now() - P->WindowStart;
+	if (P->Settling || Elapsed <= 0)
+	{
+		P->Settling = 0;
+		goto NewWindow;
+	}
+	Rate = P->WindowOps / Elapsed;
+	Mean = P->WindowLatency / P->WindowOps;
+
+	if (P->LastStep > 0)
+	{
+		double Most = 1 + AUTO_MIN_GAIN *
+			(P->Limit - P->LastLimit) / P->LastLimit;
+		if (Rate < P->LastRate * Most && Mean > P->LastLatency * Most)
+			Step = -1;	/* The last raise didn't help */
+	}
+	else if (P->LastStep == 0 && P->LastLatency > 0 &&
+		 Mean > P->LastLatency * AUTO_SLOWER)
+	{
+		Step = -1;	/* The disk has got slower */
+	}
+	if (Step == 0 && P->Limited && P->Limit < P->MaxLimit)
+		Step = 1;
+
+	P->LastLimit = P->Limit;
+	if (Step < 0)
+	{
+		P->Limit -= (P->Limit + 3) / 4;
+		if (P->Limit < 1)
+			P->Limit = 1;
+		P->SlowStart = 0;
+	}
+	else if (Step > 0)
+	{
+		P->Limit = P->SlowStart ? 2 * P->Limit : P->Limit + 1;
+		if (P->Limit > P->MaxLimit)
+			P->Limit = P->MaxLimit;
+		pthread_cond_broadcast(&P->Work);
+	}
+	if (P->Limit < P->Jobs->Lowest)
+		P->Jobs->Lowest = P->Limit;
+	if (P->Limit > P->Jobs->Highest)
+		P->Jobs->Highest = P->Limit;
+
+	P->Settling = Step != 0;
+	P->LastStep = Step;
+	P->LastRate = Rate;
+	P->LastLatency = Mean;
+NewWindow:
+	P->Limited = 0;
+	P->WindowOps = 0;
+	P->WindowLatency = 0;
+	P->WindowStart = Now();
+}
+
+/* Reads or writes a photo, if there's one to do and Limit allows, with
+ * the lock held other than while doing it. Returns 1 if it did. */
+static int DoWork(struct Pipeline* P)
+{
+	struct Slot* S;
+	double Start;
+	int i;
+
+	if (P->Writes)
+	{
+		if (P->InFlight >= P->Limit)
+			return 0;
+		for (i = P->Printed; i < P->Matched; i++)
+			if (SLOT(P, i)->State == SLOT_WRITE)
+				break;
+		S = SLOT(P, i);
+		S->State = SLOT_WRITING;
+		P->Writes--;
+		if (++P->InFlight >= P->Limit)
+			P->Limited = 1;
+		pthread_mutex_unlock(&P->Lock);
+
+		Start = Now();
+		if (!WritePhotoPoint(P->Files[i], &S->Match.Point, P->Options))
+			S->Match.Result = CORR_EXIFWRITEFAIL;
+
+		pthread_mutex_lock(&P->Lock);
+		P->InFlight--;
+		TimedWork(P, Now() - Start);
+		S->State = SLOT_DONE;
+		pthread_cond_signal(&P->Progress);
+		pthread_cond_broadcast(&P->Work);
+		return 1;
+	}
+
+	/* A photo given more than once has to wait for the one before
+	 * to be written, so it's read just as it would be in turn. */
+	i = P->NextRead;
+	if (i < P->NumFiles && i < P->Printed + P->NumSlots &&
+	    (P->SameAs[i] < P->Printed ||
+	     SLOT(P, P->SameAs[i])->State == SLOT_DONE))
+	{
+		if (P->InFlight >= P->Limit)
+			return 0;
+		P->NextRead++;
+		if (++P->InFlight >= P->Limit)
+			P->Limited = 1;
+		S = SLOT(P, i);
+		S->State = SLOT_READING;
+		pthread_mutex_unlock(&P->Lock);
+
+		Start = Now();
+		S->IncludesGPS = 0;
+		S->Date = ReadExifDate(P->Files[i], &S->IncludesGPS);
+
+		pthread_mutex_lock(&P->Lock);
+		P->InFlight--;
+		TimedWork(P, Now() - Start);
+		S->State = SLOT_READ;
+		pthread_cond_signal(&P->Progress);
+		pthread_cond_signal(&P->Work);
+		return 1;
+	}
+	return 0;
+}
+
+static void* PipelineWorker(void* Arg)
+{
+	struct Pipeline* P = (struct Pipeline*) Arg;
+
+	pthread_mutex_lock(&P->Lock);
+	while (!P->Stop)
+		if (!DoWork(P))
+			pthread_cond_wait(&P->Work, &P->Lock);
+	pthread_mutex_unlock(&P->Lock);
+	return NULL;
+}
+
+/* Matches a photo that has been read. Returns 1 if the point then has to
+ * be written into it. */
+static int MatchPhoto(struct Slot* S, struct CorrelateOptions* Options)
+{
+	time_t PhotoTime;
+
+	S->HaveTime = PhotoTimeFromExif(S->Date, S->IncludesGPS, Options,
+					&PhotoTime);
+	free(S->Date);
+	S->Date = NULL;
+	if (!S->HaveTime)
+	{
+		S->Match.Result = Options->Result;
+		S->Match.RuledOut = 0;
+		return 0;
+	}
+
+	CorrelateTime(PhotoTime, Options, &S->Match);
+	return S->Match.Result != CORR_NOMATCH &&
+	       S->Match.Result != CORR_TOOFAR && !Options->NoWriteExif;
+}
+
+int CorrelatePhotos(char* const* Files, int NumFiles,
+		struct CorrelateOptions* Options, int NumThreads,
+		struct PipelineJobs* Jobs, PhotoDoneFunc Done, void* Data)
+{
+	pthread_t Threads[MAX_PIPELINE_THREADS];
+	struct PipelineJobs NoJobs;
+	struct Pipeline P;
+	int Started;
+	int CanStart;
+	int i;
+
+	memset(&P, 0, sizeof(P));
+	if (NumThreads == PIPELINE_AUTO)
+	{
+		P.Auto = 1;
+		NumThreads = MAX_PIPELINE_THREADS;
+	}
+	if (NumThreads > MAX_PIPELINE_THREADS)
+		NumThreads = MAX_PIPELINE_THREADS;
+	if (NumThreads < 1)
+		NumThreads = 1;
+
+	P.Files = Files;
+	P.NumFiles = NumFiles;
+	P.Options = Options;
+	P.MaxLimit = NumThreads;
+	P.Limit = P.Auto ? AUTO_START_JOBS : NumThreads;
+	P.SlowStart = 1;
+	P.Jobs = Jobs ? Jobs : &NoJobs;
+	P.Jobs->Lowest = P.Jobs->Highest = P.Limit;
+	P.NumSlots = NumThreads * SLOTS_PER_THREAD;
+	P.Slots = (struct Slot*) calloc(P.NumSlots, sizeof(*P.Slots));
+	P.SameAs = (int*) malloc((NumFiles + 1) * sizeof(*P.SameAs));
+	if (!P.Slots || !P.SameAs || !FindSameNames(Files, NumFiles, P.SameAs))
+	{
+		free(P.Slots);
+		free(P.SameAs);
+		return 0;
+	}
+	pthread_mutex_init(&P.Lock, NULL);
+	pthread_cond_init(&P.Work, NULL);
+	pthread_cond_init(&P.Progress, NULL);
+
+	P.WindowStart = Now();
+	Started = 0;
+	CanStart = 1;
+
+	pthread_mutex_lock(&P.Lock);
+	while (P.Printed < NumFiles)
+	{
+		struct Slot* S;
+
+		/* Start as many threads as there can be reads and writes
+		 * at once, so long as that's allowed. */
+		while (CanStart && Started < P.Limit)
+		{
+			if (pthread_create(&Threads[Started], NULL, PipelineWorker, &P) != 0)
+				CanStart = 0;
+			else
+				Started++;
+		}
+
+		/* Match the next photo, if it's been read. */
+		if (P.Matched < P.NextRead &&
+		    (S = SLOT(&P, P.Matched))->State == SLOT_READ)
+		{
+			int Write;
+
+			pthread_mutex_unlock(&P.Lock);
+			Write = MatchPhoto(S, Options);
+			pthread_mutex_lock(&P.Lock);
+
+			if (Write)
+			{
+				S->State = SLOT_WRITE;
+				P.Writes++;
+			} else {
+				S->State = SLOT_DONE;
+			}
+			P.Matched++;
+			pthread_cond_broadcast(&P.Work);
+			continue;
+		}
+
+		/* Hand back the next photo, if it's done with. */
+		if (P.Printed < P.Matched &&
+		    (S = SLOT(&P, P.Printed))->State == SLOT_DONE)
+		{
+			struct CorrelateResult Match = S->Match;
+			int HaveTime = S->HaveTime;
+			int Photo = P.Printed;
+
+			S->State = SLOT_FREE;
+			P.Printed++;
+			pthread_cond_broadcast(&P.Work);
+			pthread_mutex_unlock(&P.Lock);
+			Done(Files[Photo], HaveTime, &Match, Data);
+			pthread_mutex_lock(&P.Lock);
+			continue;
+		}
+
+		/* With no threads to do the reading and writing, do it
+		 * here instead. */
+		if (!Started && DoWork(&P))
+			continue;
+		pthread_cond_wait(&P.Progress, &P.Lock);
+	}
+	P.Stop = 1;
+	pthread_cond_broadcast(&P.Work);
+	pthread_mutex_unlock(&P.Lock);
+
+	for (i = 0; i < Started; i++)
+		pthread_join(Threads[i], NULL);
+	P.Jobs->Last = P.Limit;
+
+	pthread_cond_destroy(&P.Progress);
+	pthread_cond_destroy(&P.Work);
+	pthread_mutex_destroy(&P.Lock);
+	free(P.Slots);
+	free(P.SameAs);
+	return 1;
+}
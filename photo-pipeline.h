@@ -0,0 +1,68 @@
+/* photo-pipeline.h
+ * This file contains prototypes for the functions
+ * in photo-pipeline.c.
+ */
+
+/* Copyright 2026 the gpscorrelate authors.
+ *
+ * This file is part of gpscorrelate.
+ *
+ * gpscorrelate is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * gpscorrelate is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with gpscorrelate; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+struct CorrelateOptions;
+struct CorrelateResult;
+
+/* Most threads CorrelatePhotos will use */
+#define MAX_PIPELINE_THREADS 64
+
+/* Given as the number of threads to CorrelatePhotos, to have it find how
+ * many photos to read and write at once as it goes */
+#define PIPELINE_AUTO 0
+
+/* The number of photos CorrelatePhotos read and wrote at once: the fewest
+ * and most it allowed, and how many at the end */
+struct PipelineJobs {
+	int Lowest;
+	int Highest;
+	int Last;
+};
+
+/* Sets SameAs[i] to the last of Files[0] to Files[i - 1] with the same
+ * name as Files[i], or -1 if there's none. Returns 0 if there isn't the
+ * memory. */
+int FindSameNames(char* const* Files, int NumFiles, int* SameAs);
+
+/* Called by CorrelatePhotos with what happened to each photo, in the
+ * order they were given. HaveTime is set if the time the photo was taken
+ * could be used. Match->Result is one of the CORR_ codes, and Match->Point
+ * is the point found for it if that's _OK, _INTERPOLATED, _ROUND or
+ * _EXIFWRITEFAIL. */
+typedef void (*PhotoDoneFunc)(const char* File, int HaveTime,
+		const struct CorrelateResult* Match, void* Data);
+
+/* Correlates the photos Files[0] to Files[NumFiles - 1], just as calling
+ * CorrelatePhoto for each in turn would. NumThreads threads read the
+ * photos and write the points back into them, while this one matches
+ * their times, in order, and calls Done for each as it's finished with.
+ * Only a few photos per thread are in hand at once. A photo given more
+ * than once isn't read again until it has been written. With NumThreads
+ * PIPELINE_AUTO, the number read and written at once starts low and is
+ * raised or lowered by how long each read and write takes. If Jobs isn't
+ * NULL, it's filled in with how many were. Returns 0 if there isn't the
+ * memory. */
+int CorrelatePhotos(char* const* Files, int NumFiles,
+		struct CorrelateOptions* Options, int NumThreads,
+		struct PipelineJobs* Jobs, PhotoDoneFunc Done, void* Data);
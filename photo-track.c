@@ -0,0 +1,602 @@
+/* photo-track.c
+ * This file contains routines for building a track out of a directory of
+ * photos that were geotagged when they were taken, such as those from a
+ * phone, so they can be used to place photos from a camera that wasn't.
+ *
+ * The photos are read several at a time, then the ones with a position
+ * are sorted by the time they were taken to make the track. When track
+ * caching is turned on, what was found in each photo is kept in a cache
+ * file for the directory, along with the size and modification time of
+ * the photo. Next time, only photos that have been added or changed since
+ * are read again.
+ */
+
+/* Copyright 2026 the gpscorrelate authors.
+ *
+ * This file is part of gpscorrelate.
+ *
+ * gpscorrelate is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * gpscorrelate is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with gpscorrelate; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <ctype.h>
+#include <math.h>
+#include <time.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <pthread.h>
+
+#include "i18n.h"
+#include "photo-track.h"
+#include "track-load.h"
+#include "track-cache.h"
+#include "gpsstructure.h"
+#include "exif-gps.h"
+#include "unixtime.h"
+
+#define PHOTO_MAGIC "gpsphoto"
+#define PHOTO_VERSION 1
+/* Reads differently on a machine with another byte order */
+#define PHOTO_ORDER 0x01020304
+
+/* Most threads to read photos on */
+#define MAX_THREADS 64
+
+/* Photos taken further apart than this, in seconds, are put in separate
+ * track segments. */
+#define MAX_GAP (30 * 60)
+
+/* There's no telling how many decimal places the position in a photo is
+ * good to, so use the same number as --show-gpx writes. */
+#define LATLONG_DECIMALS 6
+#define ELEV_DECIMALS 3
+
+/* What has been found in a photo */
+#define PHOTO_TIME 1		/* The time it was taken */
+#define PHOTO_POSITION 2	/* Its latitude and longitude */
+#define PHOTO_ELEV 4		/* Its elevation */
+
+/* The file name extensions of the photos that are read, in lower case */
+static const char* const Extensions[] = {
+	"jpg", "jpeg", "heic", "heif", "avif", "dng", "tif", "tiff",
+	"png", "webp", NULL
+};
+
+struct Photo {
+	char* Name;		/* Within the directory */
+	int64_t Size;
+	int64_t ModTime;
+	int64_t Time;		/* Local time it was taken, as if it were UTC */
+	double Lat;
+	double Long;
+	double Elev;
+	uint32_t Flags;
+	int Known;		/* Set if it was found in the cache */
+};
+
+/* A cache file holds this header, followed by a record for each photo in
+ * order of name, then the full name of the directory, then the names of
+ * the photos, one after another. */
+struct PhotoCacheHeader {
+	char Magic[8];
+	uint32_t Version;
+	uint32_t ByteOrder;
+	uint32_t NumPhotos;
+	uint32_t PathLen;
+	uint32_t NamesLen;
+	uint32_t Unused;
+};
+
+struct PhotoRecord {
+	int64_t Size;
+	int64_t ModTime;
+	int64_t Time;
+	double Lat;
+	double Long;
+	double Elev;
+	uint32_t Name;		/* Where its name starts among the names */
+	uint32_t NameLen;
+	uint32_t Flags;
+	uint32_t Unused;
+};
+
+struct Scan {
+	const char* Dir;
+	struct Photo* Photos;
+	size_t NumPhotos;
+	size_t Next;		/* Next photo to hand out */
+	pthread_mutex_t Lock;
+};
+
+static int HaveZone = 0;
+static long ZoneOffset = 0;
+
+void SetPhotoTrackZone(int Hours, int Mins)
+{
+	HaveZone = 1;
+	ZoneOffset = Hours * 3600L + Mins * 60L;
+}
+
+int IsPhotoDirectory(const char* File)
+{
+	struct stat Info;
+
+	return stat(File, &Info) == 0 && S_ISDIR(Info.st_mode);
+}
+
+/* Returns 1 if a file name looks like that of a photo. */
+static int IsPhotoName(const char* Name)
+{
+	const char* Ext = strrchr(Name, '.');
+	int i, j;
+
+	/* Skip hidden files, and any without an extension */
+	if (Ext == NULL || Name[0] == '.')
+		return 0;
+	Ext++;
+
+	for (i = 0; Extensions[i]; i++) {
+		for (j = 0; Ext[j] && Extensions[i][j]; j++)
+			if (tolower((unsigned char) Ext[j]) != Extensions[i][j])
+				break;
+		if (!Ext[j] && !Extensions[i][j])
+			return 1;
+	}
+	return 0;
+}
+
+/* Returns the name of a file in a directory, which must be freed by the
+ * caller. */
+static char* JoinPath(const char* Dir, const char* Name)
+{
+	size_t Len = strlen(Dir) + 1 + strlen(Name) + 1;
+	char* Path = (char*) malloc(Len);
+
+	if (Path)
+		snprintf(Path, Len, "%s/%s", Dir, Name);
+	return Path;
+}
+
+static int ComparePhotoNames(const void* a, const void* b)
+{
+	return strcmp(((const struct Photo*) a)->Name,
+			((const struct Photo*) b)->Name);
+}
+
+static int ComparePhotoTimes(const void* a, const void* b)
+{
+	const struct Photo* A = *(const struct Photo* const*) a;
+	const struct Photo* B = *(const struct Photo* const*) b;
+
+	if (A->Time != B->Time)
+		return A->Time < B->Time ? -1 : 1;
+	return strcmp(A->Name, B->Name);
+}
+
+/* Compares the name of a photo with one from a cache file in the same way
+ * as strcmp would. */
+static int CompareCachedName(const char* Name, const char* Cached, size_t CachedLen)
+{
+	size_t Len = strlen(Name);
+	int Cmp = memcmp(Name, Cached, Len < CachedLen ? Len : CachedLen);
+
+	if (Cmp == 0 && Len != CachedLen)
+		Cmp = Len < CachedLen ? -1 : 1;
+	return Cmp;
+}
+
+/* Lists the photos in a directory, sorted by name. Returns 0 if the
+ * directory can't be read. */
+static int ListPhotos(const char* Dir, struct Photo** Photos, size_t* NumPhotos)
+{
+	struct Photo* List = NULL;
+	struct dirent* Entry;
+	struct stat Info;
+	size_t Max = 0;
+	size_t N = 0;
+	DIR* D;
+
+	D = opendir(Dir);
+	if (D == NULL)
+		return 0;
+
+	while ((Entry = readdir(D)) != NULL) {
+		char* Path;
+		int Ok;
+
+		if (!IsPhotoName(Entry->d_name))
+			continue;
+		Path = JoinPath(Dir, Entry->d_name);
+		Ok = Path && stat(Path, &Info) == 0 && S_ISREG(Info.st_mode);
+		free(Path);
+		if (!Ok)
+			continue;
+
+		if (N == Max) {
+			Max = Max ? Max * 2 : 64;
+			List = (struct Photo*) realloc(List, Max * sizeof(*List));
+		}
+		if (List) {
+			memset(&List[N], 0, sizeof(List[N]));
+			List[N].Name = strdup(Entry->d_name);
+		}
+		if (List == NULL || List[N].Name == NULL) {
+			fprintf(stderr, _("Out of memory.\n"));
+			abort();
+		}
+		List[N].Size = (int64_t) Info.st_size;
+		List[N].ModTime = (int64_t) Info.st_mtime;
+		N++;
+	}
+	closedir(D);
+
+	if (N > 1)
+		qsort(List, N, sizeof(*List), ComparePhotoNames);
+	*Photos = List;
+	*NumPhotos = N;
+	return 1;
+}
+
+/* Fills in what is already known about the photos from the cache file for
+ * their directory, for those that haven't changed since. Returns the
+ * number of photos in the cache, or 0 if there isn't a good one. */
+static size_t LoadPhotoCache(const char* Name, const char* Path,
+		struct Photo* Photos, size_t NumPhotos)
+{
+	struct PhotoCacheHeader H;
+	const struct PhotoRecord* Records;
+	const char* Names;
+	struct stat Info;
+	size_t PathLen = strlen(Path);
+	size_t Size;
+	size_t i, j;
+	char* Buffer;
+	FILE* In;
+
+	if (stat(Name, &Info) != 0 || !S_ISREG(Info.st_mode) ||
+	    Info.st_size < (off_t) sizeof(H) ||
+	    (unsigned long long) Info.st_size > (size_t) -1)
+		return 0;
+	Size = (size_t) Info.st_size;
+
+	In = fopen(Name, "rb");
+	if (In == NULL)
+		return 0;
+	Buffer = (char*) malloc(Size);
+	if (Buffer == NULL || fread(Buffer, 1, Size, In) != Size) {
+		free(Buffer);
+		fclose(In);
+		return 0;
+	}
+	fclose(In);
+
+	/* The header and each record are a multiple of 8 bytes long, so the
+	 * records are suitably aligned within the buffer. */
+	memcpy(&H, Buffer, sizeof(H));
+	if (memcmp(H.Magic, PHOTO_MAGIC, sizeof(H.Magic)) != 0 ||
+	    H.Version != PHOTO_VERSION || H.ByteOrder != PHOTO_ORDER ||
+	    H.PathLen != PathLen ||
+	    H.NumPhotos > (Size - sizeof(H)) / sizeof(struct PhotoRecord) ||
+	    sizeof(H) + H.NumPhotos * sizeof(struct PhotoRecord) +
+			(size_t) H.PathLen + H.NamesLen != Size) {
+		free(Buffer);
+		return 0;
+	}
+	Records = (const struct PhotoRecord*) (Buffer + sizeof(H));
+	Names = (const char*) (Records + H.NumPhotos);
+	if (memcmp(Names, Path, PathLen) != 0) {
+		free(Buffer);
+		return 0;
+	}
+	Names += PathLen;
+
+	/* Both lists are sorted by name, so go through them side by side */
+	for (i = j = 0; i < NumPhotos && j < H.NumPhotos; ) {
+		const struct PhotoRecord* R = &Records[j];
+		int Cmp;
+
+		if (R->Name > H.NamesLen || R->NameLen > H.NamesLen - R->Name) {
+			j++;
+			continue;
+		}
+		Cmp = CompareCachedName(Photos[i].Name, Names + R->Name, R->NameLen);
+		if (Cmp < 0) {
+			i++;
+		} else if (Cmp > 0) {
+			j++;
+		} else {
+			if (Photos[i].Size == R->Size && Photos[i].ModTime == R->ModTime) {
+				Photos[i].Time = R->Time;
+				Photos[i].Lat = R->Lat;
+				Photos[i].Long = R->Long;
+				Photos[i].Elev = R->Elev;
+				Photos[i].Flags = R->Flags;
+				Photos[i].Known = 1;
+			}
+			i++;
+			j++;
+		}
+	}
+
+	free(Buffer);
+	return H.NumPhotos;
+}
+
+/* Writes what was found in each photo to the cache file for their
+ * directory. */
+static void WritePhotoCache(const char* Name, const char* Path,
+		const struct Photo* Photos, size_t NumPhotos)
+{
+	struct PhotoCacheHeader H;
+	struct PhotoRecord* Records;
+	size_t PathLen = strlen(Path);
+	size_t NamesLen = 0;
+	size_t Size;
+	size_t i;
+	char* Names;
+	char* Image;
+
+	for (i = 0; i < NumPhotos; i++)
+		NamesLen += strlen(Photos[i].Name);
+	if (NumPhotos > UINT32_MAX || PathLen > UINT32_MAX || NamesLen > UINT32_MAX)
+		return;
+	Size = sizeof(H) + NumPhotos * sizeof(*Records) + PathLen + NamesLen;
+	Image = (char*) calloc(1, Size);
+	if (Image == NULL)
+		return;
+
+	memset(&H, 0, sizeof(H));
+	memcpy(H.Magic, PHOTO_MAGIC, sizeof(H.Magic));
+	H.Version = PHOTO_VERSION;
+	H.ByteOrder = PHOTO_ORDER;
+	H.NumPhotos = (uint32_t) NumPhotos;
+	H.PathLen = (uint32_t) PathLen;
+	H.NamesLen = (uint32_t) NamesLen;
+	memcpy(Image, &H, sizeof(H));
+
+	Records = (struct PhotoRecord*) (Image + sizeof(H));
+	Names = (char*) (Records + NumPhotos);
+	memcpy(Names, Path, PathLen);
+	Names += PathLen;
+
+	NamesLen = 0;
+	for (i = 0; i < NumPhotos; i++) {
+		size_t Len = strlen(Photos[i].Name);
+
+		Records[i].Size = Photos[i].Size;
+		Records[i].ModTime = Photos[i].ModTime;
+		Records[i].Time = Photos[i].Time;
+		Records[i].Lat = Photos[i].Lat;
+		Records[i].Long = Photos[i].Long;
+		Records[i].Elev = Photos[i].Elev;
+		Records[i].Name = (uint32_t) NamesLen;
+		Records[i].NameLen = (uint32_t) Len;
+		Records[i].Flags = Photos[i].Flags;
+		memcpy(Names + NamesLen, Photos[i].Name, Len);
+		NamesLen += Len;
+	}
+
+	WriteCacheFile(Name, Image, Size);
+	free(Image);
+}
+
+/* Reads the time and position out of a photo. */
+static void ReadPhoto(const char* Dir, struct Photo* P)
+{
+	double Lat = NAN, Long = NAN, Elev = NAN;
+	int IncludesGPS = 0;
+	char* Path;
+	char* Time = NULL;
+	time_t PhotoTime;
+
+	Path = JoinPath(Dir, P->Name);
+	if (Path)
+		Time = ReadExifData(Path, &Lat, &Long, &Elev, &IncludesGPS);
+
+	P->Flags = 0;
+	P->Time = 0;
+	P->Lat = P->Long = P->Elev = 0;
+	if (Time && ConvertExifTime(Time, &PhotoTime)) {
+		P->Flags |= PHOTO_TIME;
+		P->Time = (int64_t) PhotoTime;
+		if (IncludesGPS && !isnan(Lat) && !isnan(Long)) {
+			P->Flags |= PHOTO_POSITION;
+			P->Lat = Lat;
+			P->Long = Long;
+			if (!isnan(Elev)) {
+				P->Flags |= PHOTO_ELEV;
+				P->Elev = Elev;
+			}
+		}
+	}
+
+	free(Time);
+	free(Path);
+}
+
+static void* ScanWorker(void* Arg)
+{
+	struct Scan* S = (struct Scan*) Arg;
+	size_t i;
+
+	for (;;) {
+		pthread_mutex_lock(&S->Lock);
+		while (S->Next < S->NumPhotos && S->Photos[S->Next].Known)
+			S->Next++;
+		i = S->Next;
+		if (i < S->NumPhotos)
+			S->Next++;
+		pthread_mutex_unlock(&S->Lock);
+
+		if (i >= S->NumPhotos)
+			break;
+		ReadPhoto(S->Dir, &S->Photos[i]);
+	}
+	return NULL;
+}
+
+/* Reads each photo that isn't already known, several at a time. */
+static void ReadPhotos(const char* Dir, struct Photo* Photos, size_t NumPhotos,
+		size_t NumToRead)
+{
+	pthread_t Threads[MAX_THREADS];
+	struct Scan S;
+	long NumThreads;
+	int Started;
+	int i;
+
+	NumThreads = NumCPUs();
+	if ((size_t) NumThreads > NumToRead)
+		NumThreads = (long) NumToRead;
+	if (NumThreads > MAX_THREADS)
+		NumThreads = MAX_THREADS;
+
+	memset(&S, 0, sizeof(S));
+	S.Dir = Dir;
+	S.Photos = Photos;
+	S.NumPhotos = NumPhotos;
+	pthread_mutex_init(&S.Lock, NULL);
+
+	/* This thread reads photos too, so it doesn't matter if no others
+	 * could be started. */
+	for (Started = 0; Started < NumThreads - 1; Started++)
+		if (pthread_create(&Threads[Started], NULL, ScanWorker, &S) != 0)
+			break;
+	ScanWorker(&S);
+	for (i = 0; i < Started; i++)
+		pthread_join(Threads[i], NULL);
+
+	pthread_mutex_destroy(&S.Lock);
+}
+
+/* Makes a track out of the photos that have a position, in the order
+ * they were taken. */
+static void BuildTrack(struct Photo* Photos, size_t NumPhotos, struct GPSTrack* Track)
+{
+	struct Photo** Sorted;
+	long Offset;
+	size_t N = 0;
+	size_t i;
+
+	memset(Track, 0, sizeof(*Track));
+	if (NumPhotos == 0)
+		return;
+	Sorted = (struct Photo**) malloc(NumPhotos * sizeof(*Sorted));
+	if (Sorted == NULL) {
+		fprintf(stderr, _("Out of memory.\n"));
+		abort();
+	}
+	for (i = 0; i < NumPhotos; i++)
+		if ((Photos[i].Flags & (PHOTO_TIME | PHOTO_POSITION)) ==
+				(PHOTO_TIME | PHOTO_POSITION))
+			Sorted[N++] = &Photos[i];
+	if (N == 0) {
+		free(Sorted);
+		return;
+	}
+	qsort(Sorted, N, sizeof(*Sorted), ComparePhotoTimes);
+
+	/* The photos are dated in local time, which is turned into UTC
+	 * just as it is for the photos being correlated. */
+	Offset = HaveZone ? ZoneOffset : LocalTimeOffset((time_t) Sorted[0]->Time);
+
+	for (i = 0; i < N; i++) {
+		const struct Photo* P = Sorted[i];
+		struct GPSPoint Point;
+
+		/* Another photo taken in the same second adds nothing */
+		if (i > 0 && P->Time == Sorted[i - 1]->Time)
+			continue;
+
+		Point.Lat = P->Lat;
+		Point.LatDecimals = LATLONG_DECIMALS;
+		Point.Long = P->Long;
+		Point.LongDecimals = LATLONG_DECIMALS;
+		if (P->Flags & PHOTO_ELEV) {
+			Point.Elev = P->Elev;
+			Point.ElevDecimals = ELEV_DECIMALS;
+		} else {
+			Point.Elev = 0;
+			Point.ElevDecimals = -1;
+		}
+		Point.Time = (time_t) (P->Time - Offset);
+
+		if (Track->NumPoints &&
+		    Point.Time - Track->Time[Track->NumPoints - 1] > MAX_GAP)
+			EndTrackSegment(Track);
+		if (!AddTrackPoint(Track, &Point)) {
+			fprintf(stderr, _("Out of memory.\n"));
+			abort();
+		}
+	}
+	free(Sorted);
+
+	EndTrackSegment(Track);
+	GetTrackRange(Track);
+}
+
+int ReadPhotoTrack(const char* Dir, struct GPSTrack* Track)
+{
+	struct Photo* Photos;
+	size_t NumPhotos;
+	size_t NumCached = 0;
+	size_t NumToRead = 0;
+	char* CachePath;
+	char* CacheName;
+	char* Trimmed;
+	size_t i;
+
+	if (!ListPhotos(Dir, &Photos, &NumPhotos)) {
+		TrackReadError(_("Failed to read photos in %s.\n"), Dir);
+		return 0;
+	}
+
+	/* With a slash on the end, the cache would go inside the directory */
+	Trimmed = strdup(Dir);
+	if (Trimmed == NULL) {
+		fprintf(stderr, _("Out of memory.\n"));
+		abort();
+	}
+	for (i = strlen(Trimmed); i > 1 && Trimmed[i - 1] == '/'; i--)
+		Trimmed[i - 1] = '\0';
+	CacheName = TrackCacheName(Trimmed, &CachePath);
+	free(Trimmed);
+	if (CacheName)
+		NumCached = LoadPhotoCache(CacheName, CachePath, Photos, NumPhotos);
+
+	for (i = 0; i < NumPhotos; i++)
+		if (!Photos[i].Known)
+			NumToRead++;
+	if (NumToRead > 0)
+		ReadPhotos(Dir, Photos, NumPhotos, NumToRead);
+
+	/* Only write the cache again if there's something new for it */
+	if (CacheName && (NumToRead > 0 || NumCached != NumPhotos))
+		WritePhotoCache(CacheName, CachePath, Photos, NumPhotos);
+
+	BuildTrack(Photos, NumPhotos, Track);
+
+	for (i = 0; i < NumPhotos; i++)
+		free(Photos[i].Name);
+	free(Photos);
+	free(CacheName);
+	free(CachePath);
+	return 1;
+}
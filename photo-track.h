@@ -0,0 +1,40 @@
+/* photo-track.h
+ * This file contains prototypes for the functions
+ * in photo-track.c.
+ */
+
+/* Copyright 2026 the gpscorrelate authors.
+ *
+ * This file is part of gpscorrelate.
+ *
+ * gpscorrelate is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * gpscorrelate is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with gpscorrelate; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+struct GPSTrack;
+
+/* Sets the time zone the clock that dated the photos was set to, as
+ * given with --timeadd. If this isn't called, the local time zone as of
+ * the first photo is used, just as for the photos being correlated.
+ * This must be called before any photos are read. */
+void SetPhotoTrackZone(int Hours, int Mins);
+
+/* Returns 1 if File is a directory, which is taken to be full of
+ * photos that already have their positions in them. */
+int IsPhotoDirectory(const char* File);
+
+/* Builds a track from the time and position in each geotagged photo in
+ * the directory Dir. Photos without a position are skipped. Returns 1 on
+ * success or 0 if the directory can't be read. */
+int ReadPhotoTrack(const char* Dir, struct GPSTrack* Track);
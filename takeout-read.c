@@ -0,0 +1,414 @@
+/* takeout-read.c
+ * This file contains routines for reading the track from a Google
+ * location history file, the Records.json of a Google Takeout export.
+ *
+ * These files can run to several gigabytes, so rather than loading the
+ * JSON document, it is tokenised a block at a time and only the members
+ * of each entry of the "locations" array that are needed are kept: the
+ * latitudeE7 and longitudeE7 coordinates, the altitude and the timestamp
+ * (or timestampMs in older exports). Phones only record a location every
+ * so often, and not at all when they're switched off, so the track
+ * segment ends wherever two locations are a long way apart in time.
+ */
+
+/* Copyright 2026 the gpscorrelate authors.
+ *
+ * This file is part of gpscorrelate.
+ *
+ * gpscorrelate is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * gpscorrelate is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with gpscorrelate; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "i18n.h"
+#include "takeout-read.h"
+#include "decompress.h"
+#include "track-load.h"
+#include "unixtime.h"
+#include "gpsstructure.h"
+#include "latlong.h"
+
+/* Size of the buffer the file is read into */
+#define TAKEOUT_BUFFER 65536
+
+/* Deepest nesting of objects and arrays allowed. Location history only
+ * goes a few levels deep. */
+#define MAX_DEPTH 64
+
+/* Longest key or value kept. Anything longer isn't one we need. */
+#define MAX_TOKEN 64
+
+/* Locations further apart than this, in seconds, are put in separate
+ * track segments. */
+#define MAX_GAP (30 * 60)
+
+/* Coordinates are in units of 10^-7 degrees */
+#define E7_DECIMALS 7
+
+enum TakeoutMode {
+	IN_VALUE,		/* Between tokens */
+	IN_STRING,
+	IN_ESCAPE,		/* After a backslash in a string */
+	IN_SCALAR		/* In a number, true, false or null */
+};
+
+struct TakeoutState {
+	enum TakeoutMode Mode;
+	int Error;
+
+	/* The open objects and arrays, as '{' or '[' */
+	char Containers[MAX_DEPTH];
+	int Depth;
+	int ExpectKey;		/* The next string is a key */
+	int LocationsDepth;	/* Depth inside the locations array, or 0 */
+
+	char Token[MAX_TOKEN];
+	size_t TokenLen;	/* May be more than MAX_TOKEN if truncated */
+	char Key[MAX_TOKEN];	/* Latest key in the innermost object */
+
+	/* The location being read */
+	int HaveLat, HaveLong, HaveTime;
+	double Lat, Long;
+	double Altitude;
+	int AltitudeDecimals;
+	time_t Time;
+
+	struct GPSTrack Points;
+};
+
+static int IsSpace(char c)
+{
+	return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+int IsTakeout(const char* Start, size_t Len)
+{
+	const char* End = Start + Len;
+	const char* p = Start;
+
+	if (Len >= 3 && memcmp(p, "\xef\xbb\xbf", 3) == 0)
+		p += 3;
+	while (p < End && IsSpace(*p))
+		p++;
+	if (p == End || *p++ != '{')
+		return 0;
+	while (p < End && IsSpace(*p))
+		p++;
+	return End - p >= 11 && memcmp(p, "\"locations\"", 11) == 0;
+}
+
+/* Reads an integer number of 10^-7 degrees. */
+static int ReadE7(const char* p, const char* End, long Max, double* Value)
+{
+	int Negative = 0;
+	long long E7 = 0;
+	int Digits = 0;
+
+	if (p < End && *p == '-') {
+		Negative = 1;
+		p++;
+	}
+	for (; p < End && *p >= '0' && *p <= '9' && Digits < 11; p++, Digits++)
+		E7 = E7 * 10 + (*p - '0');
+	if (Digits == 0 || p != End)
+		return 0;
+	if (Negative)
+		E7 = -E7;
+
+	/* Some exports have negative coordinates wrapped around as though
+	 * they were unsigned 32 bit numbers. */
+	if (E7 > Max)
+		E7 -= 4294967296LL;
+	if (E7 < -Max || E7 > Max)
+		return 0;
+	*Value = (double) E7 / 1e7;
+	return 1;
+}
+
+/* Reads a time given in milliseconds since 1970. */
+static int ReadMillis(const char* p, const char* End, time_t* Time)
+{
+	long long Millis = 0;
+	int Digits = 0;
+
+	for (; p < End && *p >= '0' && *p <= '9' && Digits < 18; p++, Digits++)
+		Millis = Millis * 10 + (*p - '0');
+	if (Digits == 0 || p != End)
+		return 0;
+	*Time = (time_t) (Millis / 1000);
+	return 1;
+}
+
+/* Starts a new entry of the locations array. */
+static void StartLocation(struct TakeoutState* S)
+{
+	S->HaveLat = 0;
+	S->HaveLong = 0;
+	S->HaveTime = 0;
+	S->AltitudeDecimals = -1;
+}
+
+/* Adds the entry of the locations array just read to the track, if it
+ * has everything we need. */
+static void EndLocation(struct TakeoutState* S)
+{
+	struct GPSPoint Point;
+	size_t Last = S->Points.NumPoints;
+
+	if (!S->HaveLat || !S->HaveLong || !S->HaveTime)
+		return;
+
+	Point.Lat = S->Lat;
+	Point.LatDecimals = E7_DECIMALS;
+	Point.Long = S->Long;
+	Point.LongDecimals = E7_DECIMALS;
+	Point.Time = S->Time;
+	if (S->AltitudeDecimals >= 0) {
+		Point.Elev = S->Altitude;
+		Point.ElevDecimals = S->AltitudeDecimals;
+	} else {
+		Point.Elev = 0;
+		Point.ElevDecimals = -1;
+	}
+
+	/* Don't guess where the phone went while it wasn't recording */
+	if (Last && (S->Time - S->Points.Time[Last - 1] > MAX_GAP ||
+		     S->Time < S->Points.Time[Last - 1]))
+		EndTrackSegment(&S->Points);
+
+	if (!AddTrackPoint(&S->Points, &Point)) {
+		fprintf(stderr, _("Out of memory.\n"));
+		abort();
+	}
+}
+
+/* Deals with a whole string, number or literal. */
+static void EndToken(struct TakeoutState* S, int IsString)
+{
+	const char* Token = S->Token;
+	const char* End = S->Token + S->TokenLen;
+
+	if (S->Depth > 0 && S->Containers[S->Depth - 1] == '{' && S->ExpectKey) {
+		/* An overlong key won't match any we look for */
+		if (S->TokenLen >= MAX_TOKEN || !IsString)
+			S->Key[0] = '\0';
+		else
+			memcpy(S->Key, Token, S->TokenLen + 1);
+		S->ExpectKey = 0;
+		return;
+	}
+
+	/* Only the members of the entries of the locations array matter */
+	if (!S->LocationsDepth || S->Depth != S->LocationsDepth + 1 ||
+	    S->Containers[S->Depth - 1] != '{' || S->TokenLen >= MAX_TOKEN)
+		return;
+
+	if (strcmp(S->Key, "latitudeE7") == 0) {
+		S->HaveLat = ReadE7(Token, End, 900000000L, &S->Lat);
+	} else if (strcmp(S->Key, "longitudeE7") == 0) {
+		S->HaveLong = ReadE7(Token, End, 1800000000L, &S->Long);
+	} else if (strcmp(S->Key, "timestamp") == 0 && IsString) {
+		S->HaveTime = ConvertGPXTime(Token, S->TokenLen, &S->Time);
+	} else if (strcmp(S->Key, "timestampMs") == 0 && !S->HaveTime) {
+		/* Older exports give the time in ms, as a string */
+		S->HaveTime = ReadMillis(Token, End, &S->Time);
+	} else if (strcmp(S->Key, "altitude") == 0 && !IsString &&
+		   (*Token == '-' || (*Token >= '0' && *Token <= '9'))) {
+		S->Altitude = ParseDecimal(Token, End, &S->AltitudeDecimals);
+	}
+}
+
+static void AddToToken(struct TakeoutState* S, char c)
+{
+	if (S->TokenLen < MAX_TOKEN - 1)
+		S->Token[S->TokenLen] = c;
+	S->TokenLen++;
+}
+
+static void AddRunToToken(struct TakeoutState* S, const char* Run, size_t Len)
+{
+	if (S->TokenLen < MAX_TOKEN - 1)
+		memcpy(S->Token + S->TokenLen, Run,
+			Len < MAX_TOKEN - 1 - S->TokenLen ? Len : MAX_TOKEN - 1 - S->TokenLen);
+	S->TokenLen += Len;
+}
+
+static void FinishToken(struct TakeoutState* S, int IsString)
+{
+	S->Token[S->TokenLen < MAX_TOKEN ? S->TokenLen : MAX_TOKEN - 1] = '\0';
+	EndToken(S, IsString);
+	S->Mode = IN_VALUE;
+}
+
+/* Deals with a character between tokens. */
+static void Punctuation(struct TakeoutState* S, char c)
+{
+	switch (c) {
+	case '{':
+	case '[':
+		if (S->Depth == MAX_DEPTH) {
+			S->Error = 1;
+			return;
+		}
+		if (S->Depth == 1 && c == '[' && S->Containers[0] == '{' &&
+		    strcmp(S->Key, "locations") == 0)
+			S->LocationsDepth = 2;
+		else if (S->LocationsDepth && S->Depth == S->LocationsDepth && c == '{')
+			StartLocation(S);
+		S->Containers[S->Depth++] = c;
+		S->ExpectKey = c == '{';
+		S->Key[0] = '\0';
+		break;
+
+	case '}':
+	case ']':
+		if (S->Depth == 0 || S->Containers[S->Depth - 1] != (c == '}' ? '{' : '[')) {
+			S->Error = 1;
+			return;
+		}
+		if (S->LocationsDepth && S->Depth == S->LocationsDepth + 1 && c == '}')
+			EndLocation(S);
+		else if (S->Depth == S->LocationsDepth)
+			S->LocationsDepth = 0;
+		S->Depth--;
+		S->ExpectKey = 0;
+		break;
+
+	case ',':
+		if (S->Depth > 0 && S->Containers[S->Depth - 1] == '{')
+			S->ExpectKey = 1;
+		break;
+
+	case ':':
+	case ' ':
+	case '\t':
+	case '\r':
+	case '\n':
+		break;
+
+	case '"':
+		S->Mode = IN_STRING;
+		S->TokenLen = 0;
+		break;
+
+	default:
+		S->Mode = IN_SCALAR;
+		S->TokenLen = 0;
+		AddToToken(S, c);
+		break;
+	}
+}
+
+/* Feeds the next block of the file through the tokeniser. */
+static void ReadBlock(struct TakeoutState* S, const char* p, const char* End)
+{
+	while (p < End && !S->Error) {
+		char c = *p++;
+
+		switch (S->Mode) {
+		case IN_VALUE:
+			/* Skip indentation a run at a time */
+			while (IsSpace(c) && p < End && IsSpace(*p))
+				p++;
+			Punctuation(S, c);
+			break;
+
+		case IN_STRING: {
+			/* Strings are most of the file, so take them a run at a
+			 * time too */
+			const char* Run = p - 1;
+
+			while (c != '"' && c != '\\' && p < End)
+				c = *p++;
+			if (c == '"' || c == '\\') {
+				AddRunToToken(S, Run, (size_t) (p - 1 - Run));
+				if (c == '"')
+					FinishToken(S, 1);
+				else
+					S->Mode = IN_ESCAPE;
+			} else {
+				AddRunToToken(S, Run, (size_t) (p - Run));
+			}
+			break;
+		}
+
+		case IN_ESCAPE:
+			/* None of the strings we need have escapes that matter */
+			AddToToken(S, c);
+			S->Mode = IN_STRING;
+			break;
+
+		case IN_SCALAR:
+			if (IsSpace(c) || c == ',' || c == '}' || c == ']' || c == ':') {
+				FinishToken(S, 0);
+				Punctuation(S, c);
+			} else {
+				AddToToken(S, c);
+			}
+			break;
+		}
+	}
+}
+
+int ReadTakeout(const char* File, struct GPSTrack* Track)
+{
+	struct TakeoutState S;
+	struct Decompressor* In;
+	char* Buffer;
+	int Ok = 1;
+	int Got;
+
+	memset(&S, 0, sizeof(S));
+	S.Mode = IN_VALUE;
+
+	In = OpenDecompressed(File);
+	Buffer = (char*) malloc(TAKEOUT_BUFFER);
+	if (In == NULL || Buffer == NULL) {
+		TrackReadError(_("Failed to read location history from %s.\n"), File);
+		free(Buffer);
+		CloseCompressed(In);
+		return 0;
+	}
+
+	while ((Got = ReadCompressed(In, Buffer, TAKEOUT_BUFFER)) > 0) {
+		ReadBlock(&S, Buffer, Buffer + Got);
+		if (S.Error)
+			break;
+	}
+	if (Got < 0) {
+		/* This has been reported already */
+		Ok = 0;
+	} else if (S.Error || S.Depth != 0 || S.Mode != IN_VALUE) {
+		TrackReadError(_("Failed to read location history from %s.\n"), File);
+		Ok = 0;
+	}
+
+	free(Buffer);
+	CloseCompressed(In);
+
+	if (!Ok) {
+		FreeTrack(&S.Points);
+		return 0;
+	}
+
+	/* The end of the file is the end of a segment, too */
+	EndTrackSegment(&S.Points);
+	*Track = S.Points;
+	GetTrackRange(Track);
+	return 1;
+}
@@ -0,0 +1,226 @@
+/* bench-correlate.c
+ * Times CorrelateTimes, with its loops made for each combination of
+ * options, against CorrelateTimesGeneric, with its one loop that tests
+ * the options as it goes, on made up tracks and photos. It checks that
+ * the two give the same results as well.
+ *
+ * Run it with "make bench". The number of photos can be given on the
+ * command line; the tracks have a point a second for 8 hours a day for
+ * a month.
+ */
+
+/* Copyright 2026 the gpscorrelate authors.
+ *
+ * This file is part of gpscorrelate.
+ *
+ * gpscorrelate is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * gpscorrelate is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with gpscorrelate; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../gpsstructure.h"
+#include "../track-index.h"
+#include "../correlate.h"
+
+#define NUM_DAYS 30
+#define DAY_START 1700000000
+#define POINTS_PER_DAY (8 * 3600)
+#define RUNS 5
+
+/* A simple random number generator, so every system gets the same
+ * tracks and photos. */
+static unsigned long Seed = 12345;
+static unsigned long Random(void)
+{
+	Seed = (Seed * 1103515245UL + 12345UL) & 0x7FFFFFFFUL;
+	return Seed >> 8;
+}
+
+/* Makes a track for each day, with a few gaps where the logger
+ * was off, and a new segment every so often. */
+static struct GPSTrack* MakeTracks(int Compact)
+{
+	struct GPSTrack* Tracks = (struct GPSTrack*)
+		calloc(NUM_DAYS + 1, sizeof(struct GPSTrack));
+	int Day;
+
+	if (!Tracks)
+		return NULL;
+	for (Day = 0; Day < NUM_DAYS; Day++)
+	{
+		struct GPSPoint Point;
+		time_t Time = DAY_START + (time_t) Day * 86400;
+		long i;
+
+		Point.Lat = -33.8 + Day * 0.01;
+		Point.Long = 151.2;
+		Point.Elev = 20.0;
+		Point.LatDecimals = Point.LongDecimals = 6;
+		Point.ElevDecimals = 1;
+		for (i = 0; i < POINTS_PER_DAY; i++)
+		{
+			Point.Time = Time;
+			Point.Lat += (long) (Random() % 21 - 10) * 1e-6;
+			Point.Long += (long) (Random() % 21 - 10) * 1e-6;
+			Point.Elev += (long) (Random() % 11 - 5) * 0.1;
+			if (!AddTrackPoint(&Tracks[Day], &Point))
+				return NULL;
+			if (Random() % 2000 == 0)
+				EndTrackSegment(&Tracks[Day]);
+			Time += (Random() % 500 == 0) ? 300 : 1;
+		}
+		EndTrackSegment(&Tracks[Day]);
+		GetTrackRange(&Tracks[Day]);
+		if (Compact && !CompactTrack(&Tracks[Day]))
+			return NULL;
+	}
+	return Tracks;
+}
+
+/* Runs one of the two once, returning how long it took in seconds. */
+static double TimeRun(int Generic, const time_t* Times, size_t NumPhotos,
+		const struct CorrelateOptions* Options,
+		struct CorrelateResult* Results)
+{
+	clock_t Start = clock();
+	int Ok = Generic ?
+		CorrelateTimesGeneric(Times, NumPhotos, Options, Results) :
+		CorrelateTimes(Times, NumPhotos, Options, Results);
+
+	if (!Ok)
+	{
+		fprintf(stderr, "Out of memory.\n");
+		exit(EXIT_FAILURE);
+	}
+	return (double) (clock() - Start) / CLOCKS_PER_SEC;
+}
+
+static int SameResults(const struct CorrelateResult* A,
+		const struct CorrelateResult* B, size_t NumPhotos)
+{
+	size_t i;
+
+	for (i = 0; i < NumPhotos; i++)
+	{
+		if (A[i].Result != B[i].Result || A[i].RuledOut != B[i].RuledOut)
+			return 0;
+		if (A[i].Result == CORR_NOMATCH || A[i].Result == CORR_TOOFAR)
+			continue;
+		if (A[i].Point.Lat != B[i].Point.Lat ||
+		    A[i].Point.Long != B[i].Point.Long ||
+		    A[i].Point.Elev != B[i].Point.Elev ||
+		    A[i].Point.ElevDecimals != B[i].Point.ElevDecimals ||
+		    A[i].Point.Time != B[i].Point.Time)
+			return 0;
+	}
+	return 1;
+}
+
+int main(int argc, char** argv)
+{
+	size_t NumPhotos = argc > 1 ? (size_t) strtoul(argv[1], NULL, 10) : 2000000;
+	time_t* Times = (time_t*) malloc(NumPhotos * sizeof(*Times));
+	struct CorrelateResult* Generic = (struct CorrelateResult*)
+		malloc(NumPhotos * sizeof(*Generic));
+	struct CorrelateResult* Fixed = (struct CorrelateResult*)
+		malloc(NumPhotos * sizeof(*Fixed));
+	int Failed = 0;
+	int Compact;
+	size_t i;
+
+	if (!Times || !Generic || !Fixed)
+	{
+		fprintf(stderr, "Out of memory.\n");
+		return EXIT_FAILURE;
+	}
+
+	/* Photos taken mostly while logging, in order of time like the
+	 * files from a camera, with the odd one from another camera. */
+	for (i = 0; i < NumPhotos; i++)
+	{
+		size_t Photo = (Random() % 50 == 0) ? Random() % NumPhotos : i;
+		Times[i] = DAY_START + (time_t) (Photo * NUM_DAYS / NumPhotos) * 86400 +
+			(time_t) ((Photo * NUM_DAYS) % NumPhotos * (9 * 3600) / NumPhotos);
+	}
+
+	printf("%lu photos, %d tracks of %d points\n", (unsigned long) NumPhotos,
+	       NUM_DAYS, POINTS_PER_DAY);
+	printf("Tracks   Feather Round   Generic  Specialized  Speedup\n");
+	for (Compact = 0; Compact <= 1; Compact++)
+	{
+		struct GPSTrack* Tracks = MakeTracks(Compact);
+		int Variant;
+
+		if (!Tracks)
+		{
+			fprintf(stderr, "Out of memory.\n");
+			return EXIT_FAILURE;
+		}
+		for (Variant = 0; Variant < 4; Variant++)
+		{
+			struct CorrelateOptions Options;
+			struct TrackIndex Index;
+			double GenericTime = 0;
+			double FixedTime = 0;
+			int Run;
+
+			memset(&Options, 0, sizeof(Options));
+			Options.FeatherTime = (Variant & 1) ? 120 : 0;
+			Options.NoInterpolate = (Variant & 2) ? 1 : 0;
+			Options.Track = Tracks;
+			if (!BuildTrackIndex(&Index, Tracks, 0, Options.FeatherTime))
+			{
+				fprintf(stderr, "Out of memory.\n");
+				return EXIT_FAILURE;
+			}
+			Options.Index = &Index;
+
+			/* Take the best of a few runs of each, taking turns so
+			 * that anything else going on slows both alike. */
+			for (Run = 0; Run < RUNS; Run++)
+			{
+				double Taken = TimeRun(1, Times, NumPhotos, &Options, Generic);
+				if (Run == 0 || Taken < GenericTime)
+					GenericTime = Taken;
+				Taken = TimeRun(0, Times, NumPhotos, &Options, Fixed);
+				if (Run == 0 || Taken < FixedTime)
+					FixedTime = Taken;
+			}
+			printf("%-8s %-7s %-5s %7.3fs %11.3fs %8.2fx\n",
+			       Compact ? "compact" : "arrays",
+			       Options.FeatherTime ? "yes" : "no",
+			       Options.NoInterpolate ? "yes" : "no",
+			       GenericTime, FixedTime,
+			       FixedTime > 0 ? GenericTime / FixedTime : 0.0);
+			if (!SameResults(Generic, Fixed, NumPhotos))
+			{
+				printf("Results differ!\n");
+				Failed = 1;
+			}
+			FreeTrackIndex(&Index);
+		}
+		for (i = 0; i < NUM_DAYS; i++)
+			FreeTrack(&Tracks[i]);
+		free(Tracks);
+	}
+
+	free(Times);
+	free(Generic);
+	free(Fixed);
+	return Failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,14 @@
+# Writes a GPX file big enough to be scanned in chunks on a machine with
+# more than one processor. Its points are all in a trkseg nested inside
+# another, apart from the last, which comes after the inner one is closed
+# and so is part of the outer trkseg.
+BEGIN {
+	print "<?xml version=\"1.0\" encoding=\"UTF-8\"?>"
+	print "<gpx version=\"1.1\" creator=\"test\" xmlns=\"http://www.topografix.com/GPX/1/1\">"
+	print "<trk><trkseg><trkseg>"
+	for (i = 0; i < 100000; i++)
+		printf "<trkpt lat=\"31.%06d\" lon=\"35.%06d\"><ele>-422.0</ele><time>2012-11-%02dT%02d:%02d:%02dZ</time></trkpt>\n", i, i, 20 + int(i / 86400), int(i / 3600) % 24, int(i / 60) % 60, i % 60
+	print "</trkseg>"
+	print "<trkpt lat=\"31.5\" lon=\"35.4\"><ele>-400.0</ele><time>2012-11-22T12:34:56Z</time></trkpt>"
+	print "</trkseg></trk></gpx>"
+}
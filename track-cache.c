@@ -0,0 +1,522 @@
+/* track-cache.c
+ * This file contains routines for keeping a binary copy of each track
+ * read from a file, so the next time the same file is needed it can
+ * be loaded straight back in rather than being parsed all over again.
+ *
+ * A cache file holds a header followed by the points in flat arrays, one
+ * for each field, in this machine's own byte order. The header records
+ * the full name, size, modification time and a hash of the contents of
+ * the file the track came from, and the cache is only used if all of
+ * these still match. Anything else (a cache from another version of this
+ * format, from a machine with a different byte order, or that has been
+ * cut short) is ignored, and the track file is read and the cache written
+ * again.
+ *
+ * The arrays are laid out the same way as they are in a GPSTrack, so a
+ * track loaded from its cache just points into the file mapped into
+ * memory, and nothing is read until it's needed.
+ */
+
+/* Copyright 2026 the gpscorrelate authors.
+ *
+ * This file is part of gpscorrelate.
+ *
+ * gpscorrelate is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * gpscorrelate is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with gpscorrelate; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#ifdef _WIN32
+#include <direct.h>
+#define mkdir(Dir, Mode) _mkdir(Dir)
+#else
+#include <sys/mman.h>
+#endif
+
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
+#include "track-cache.h"
+#include "track-load.h"
+#include "gpsstructure.h"
+
+#define CACHE_MAGIC "gpscache"
+#define CACHE_SUFFIX ".gpscache"
+#define CACHE_VERSION 2
+/* Reads differently on a machine with another byte order */
+#define CACHE_ORDER 0x01020304
+
+/* How much of a track file to read at a time while hashing it. This must
+ * be a multiple of 32. */
+#define HASH_BLOCK (1024 * 1024)
+#define HASH_MUL 0x9e3779b97f4a7c15ULL
+
+struct CacheHeader {
+	char Magic[8];
+	uint32_t Version;
+	uint32_t ByteOrder;
+	/* The file the track was read from */
+	uint64_t FileSize;
+	int64_t FileTime;
+	uint64_t FileHash;
+	/* The track itself */
+	uint64_t NumPoints;
+	int64_t MinTime;
+	int64_t MaxTime;
+	uint32_t NameLen;	/* Length of the track file's full name */
+	uint32_t Unused;
+};
+
+/* Where each part of a cache file starts. The header is followed by the
+ * name of the track file, then an array for each field of the points, the
+ * larger types first so that every array is suitably aligned. These are
+ * just as they are kept in a GPSTrack, ending with the bitmap of the ends
+ * of the track segments. */
+struct CacheLayout {
+	size_t Name;
+	size_t Time;		/* int64_t */
+	size_t Lat;		/* double */
+	size_t Long;		/* double */
+	size_t Elev;		/* double */
+	size_t LatDecimals;	/* int8_t */
+	size_t LongDecimals;	/* int8_t */
+	size_t ElevDecimals;	/* int8_t */
+	size_t SegmentEnd;	/* One bit per point */
+	size_t Size;		/* Of the whole file */
+};
+
+/* What a cache file has to match for it to be used */
+struct FileId {
+	char* Path;
+	uint64_t Size;
+	int64_t Time;
+	uint64_t Hash;
+};
+
+static int CacheEnabled = 0;
+static const char* CacheDir = NULL;
+
+/* Makes the names of temporary files unique between threads */
+static pthread_mutex_t TempLock = PTHREAD_MUTEX_INITIALIZER;
+static unsigned TempCount = 0;
+
+void SetTrackCache(const char* Dir)
+{
+	CacheEnabled = 1;
+	CacheDir = Dir;
+}
+
+/* Works out where everything goes in the cache for a track. Returns 0 if
+ * it would be too big to handle. */
+static int GetLayout(uint64_t NumPoints, uint32_t NameLen, struct CacheLayout* L)
+{
+	size_t N;
+
+	if (NumPoints > ((size_t) -1 - sizeof(struct CacheHeader) - NameLen - 8) / 64)
+		return 0;
+	N = (size_t) NumPoints;
+
+	L->Name = sizeof(struct CacheHeader);
+	L->Time = (L->Name + NameLen + 7) & ~(size_t) 7;
+	L->Lat = L->Time + N * sizeof(int64_t);
+	L->Long = L->Lat + N * sizeof(double);
+	L->Elev = L->Long + N * sizeof(double);
+	L->LatDecimals = L->Elev + N * sizeof(double);
+	L->LongDecimals = L->LatDecimals + N * sizeof(int8_t);
+	L->ElevDecimals = L->LongDecimals + N * sizeof(int8_t);
+	L->SegmentEnd = L->ElevDecimals + N * sizeof(int8_t);
+	L->Size = L->SegmentEnd + (N + 7) / 8;
+	return 1;
+}
+
+/* Mixes another 8 bytes into a hash. This only needs to notice when a
+ * file has changed, not stand up to anyone trying to fool it. */
+static uint64_t Mix(uint64_t Hash, uint64_t Word)
+{
+	Hash = (Hash ^ Word) * HASH_MUL;
+	return Hash ^ (Hash >> 29);
+}
+
+/* Returns the full name of a file, which must be freed by the caller. */
+static char* FullPath(const char* File)
+{
+	char* Path;
+#ifdef _WIN32
+	Path = _fullpath(NULL, File, 0);
+#else
+	Path = realpath(File, NULL);
+#endif
+	return Path ? Path : strdup(File);
+}
+
+/* Fills in the details of a track file that a cache has to match. The file
+ * is hashed 32 bytes at a time, in four separate lanes so the work on each
+ * can overlap. Returns 0 if the file can't be read. */
+static int IdentifyFile(const char* File, struct FileId* Id)
+{
+	uint64_t Lane[4] = {1, 2, 3, 4};
+	uint64_t Word[4];
+	unsigned char* Buffer;
+	struct stat Info;
+	uint64_t Total = 0;
+	size_t Len;
+	size_t i;
+	int Ok = 1;
+	int fd;
+
+	fd = open(File, O_RDONLY | O_BINARY);
+	if (fd < 0)
+		return 0;
+	if (fstat(fd, &Info) != 0 || !S_ISREG(Info.st_mode)) {
+		close(fd);
+		return 0;
+	}
+	Buffer = (unsigned char*) malloc(HASH_BLOCK);
+	if (Buffer == NULL) {
+		close(fd);
+		return 0;
+	}
+
+	do {
+		/* A read can stop short, so keep going until the buffer is
+		 * full or the file ends. Only the last block is partly full. */
+		for (Len = 0; Len < HASH_BLOCK; ) {
+			ssize_t Got = read(fd, Buffer + Len, HASH_BLOCK - Len);
+			if (Got < 0)
+				Ok = 0;
+			if (Got <= 0)
+				break;
+			Len += (size_t) Got;
+		}
+		Total += Len;
+
+		for (i = 0; i + 32 <= Len; i += 32) {
+			memcpy(Word, Buffer + i, 32);
+			Lane[0] = Mix(Lane[0], Word[0]);
+			Lane[1] = Mix(Lane[1], Word[1]);
+			Lane[2] = Mix(Lane[2], Word[2]);
+			Lane[3] = Mix(Lane[3], Word[3]);
+		}
+		if (i < Len) {
+			memset(Word, 0, sizeof(Word));
+			memcpy(Word, Buffer + i, Len - i);
+			Lane[0] = Mix(Lane[0], Word[0]);
+			Lane[1] = Mix(Lane[1], Word[1]);
+			Lane[2] = Mix(Lane[2], Word[2]);
+			Lane[3] = Mix(Lane[3], Word[3]);
+		}
+	} while (Ok && Len == HASH_BLOCK);
+
+	free(Buffer);
+	close(fd);
+	if (!Ok)
+		return 0;
+
+	Id->Path = FullPath(File);
+	if (Id->Path == NULL)
+		return 0;
+	Id->Size = Total;
+	Id->Time = (int64_t) Info.st_mtime;
+	Id->Hash = Mix(Mix(Mix(Mix(Total, Lane[0]), Lane[1]), Lane[2]), Lane[3]);
+	return 1;
+}
+
+/* Returns the name of the cache file for a track file, which must be freed
+ * by the caller. In a cache directory, the name is made from a hash of
+ * the full name of the track file, so different files of the same name
+ * don't get mixed up. */
+static char* CacheName(const char* File, const char* Path)
+{
+	uint64_t PathHash = 0;
+	const char* p;
+	size_t Len;
+	char* Name;
+
+	if (CacheDir == NULL) {
+		Len = strlen(File) + sizeof(CACHE_SUFFIX);
+		Name = (char*) malloc(Len);
+		if (Name)
+			snprintf(Name, Len, "%s%s", File, CACHE_SUFFIX);
+		return Name;
+	}
+
+	for (p = Path; *p; p++)
+		PathHash = Mix(PathHash, (unsigned char) *p);
+	Len = strlen(CacheDir) + 1 + 16 + sizeof(CACHE_SUFFIX);
+	Name = (char*) malloc(Len);
+	if (Name)
+		snprintf(Name, Len, "%s/%08lx%08lx%s", CacheDir,
+			(unsigned long) (PathHash >> 32),
+			(unsigned long) (PathHash & 0xffffffff), CACHE_SUFFIX);
+	return Name;
+}
+
+char* TrackCacheName(const char* File, char** Path)
+{
+	char* Name;
+
+	*Path = NULL;
+	if (!CacheEnabled)
+		return NULL;
+	*Path = FullPath(File);
+	if (*Path == NULL)
+		return NULL;
+	Name = CacheName(File, *Path);
+	if (Name == NULL) {
+		free(*Path);
+		*Path = NULL;
+	}
+	return Name;
+}
+
+/* Builds a track from a cache file that has been read into memory. Where
+ * the times are 64 bits, as they are in the cache, the track's arrays
+ * just point into Map and it becomes the track's block; otherwise they're
+ * copied out of it. Returns 0 if it isn't a good cache for the track file. */
+static int UnpackCache(char* Map, size_t Size, const struct FileId* Id,
+		struct GPSTrack* Track)
+{
+	struct CacheHeader H;
+	struct CacheLayout L;
+	const int64_t* Times;
+	size_t PathLen = strlen(Id->Path);
+	size_t N;
+	size_t i;
+
+	if (Size < sizeof(H))
+		return 0;
+	memcpy(&H, Map, sizeof(H));
+	if (memcmp(H.Magic, CACHE_MAGIC, sizeof(H.Magic)) != 0 ||
+	    H.Version != CACHE_VERSION || H.ByteOrder != CACHE_ORDER ||
+	    H.FileSize != Id->Size || H.FileTime != Id->Time ||
+	    H.FileHash != Id->Hash || H.NameLen != PathLen ||
+	    !GetLayout(H.NumPoints, H.NameLen, &L) || L.Size != Size ||
+	    memcmp(Map + L.Name, Id->Path, PathLen) != 0)
+		return 0;
+
+	N = (size_t) H.NumPoints;
+	memset(Track, 0, sizeof(*Track));
+
+	/* Each array starts at a multiple of its own size from the start of
+	 * the map, which is itself page aligned. */
+	if (sizeof(time_t) == sizeof(int64_t)) {
+		Track->Time = (time_t*) (void*) (Map + L.Time);
+		Track->Lat = (double*) (void*) (Map + L.Lat);
+		Track->Long = (double*) (void*) (Map + L.Long);
+		Track->Elev = (double*) (void*) (Map + L.Elev);
+		Track->LatDecimals = (signed char*) (Map + L.LatDecimals);
+		Track->LongDecimals = (signed char*) (Map + L.LongDecimals);
+		Track->ElevDecimals = (signed char*) (Map + L.ElevDecimals);
+		Track->SegmentEnd = (unsigned char*) (Map + L.SegmentEnd);
+		Track->Block = Map;
+		Track->BlockSize = Size;
+		/* Any more points go in a new block */
+		Track->MaxPoints = N;
+	} else {
+		if (N > 0 && !ReserveTrack(Track, N))
+			return 0;
+		Times = (const int64_t*) (void*) (Map + L.Time);
+		for (i = 0; i < N; i++)
+			Track->Time[i] = (time_t) Times[i];
+		if (N > 0) {
+			memcpy(Track->Lat, Map + L.Lat, N * sizeof(double));
+			memcpy(Track->Long, Map + L.Long, N * sizeof(double));
+			memcpy(Track->Elev, Map + L.Elev, N * sizeof(double));
+			memcpy(Track->LatDecimals, Map + L.LatDecimals, N);
+			memcpy(Track->LongDecimals, Map + L.LongDecimals, N);
+			memcpy(Track->ElevDecimals, Map + L.ElevDecimals, N);
+			memcpy(Track->SegmentEnd, Map + L.SegmentEnd, (N + 7) / 8);
+		}
+	}
+	/* Points added later mustn't pick up stray bits */
+	if (N % 8 && (Track->SegmentEnd[N / 8] >> (N % 8)) != 0)
+		Track->SegmentEnd[N / 8] &= (unsigned char) ((1 << (N % 8)) - 1);
+
+	Track->NumPoints = N;
+	GetTrackRange(Track);
+	return 1;
+}
+
+/* Loads a track from its cache file. Returns 0 if there isn't a good one. */
+static int LoadCache(const char* Name, const struct FileId* Id, struct GPSTrack* Track)
+{
+	struct stat Info;
+	char* Map;
+	size_t Size;
+	int fd;
+	int Ok;
+
+	fd = open(Name, O_RDONLY | O_BINARY);
+	if (fd < 0)
+		return 0;
+	if (fstat(fd, &Info) != 0 || !S_ISREG(Info.st_mode) ||
+	    Info.st_size < (off_t) sizeof(struct CacheHeader) ||
+	    (unsigned long long) Info.st_size > (size_t) -1) {
+		close(fd);
+		return 0;
+	}
+	Size = (size_t) Info.st_size;
+
+#ifdef _WIN32
+	/* There's no mmap here, so read it all in instead. */
+	Map = (char*) malloc(Size);
+	if (Map && read(fd, Map, Size) != (ssize_t) Size) {
+		free(Map);
+		Map = NULL;
+	}
+	close(fd);
+	if (Map == NULL)
+		return 0;
+#else
+	/* The pages are only read from the file as the track gets used. A
+	 * private mapping can still be written to (marking the end of a
+	 * segment, say) without touching the file, and cache files are only
+	 * ever replaced by renaming a new one over them, so this one can't
+	 * change underneath it. */
+	Map = (char*) mmap(NULL, Size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (Map == MAP_FAILED)
+		return 0;
+#endif
+
+	Ok = UnpackCache(Map, Size, Id, Track);
+	if (Ok && Track->Block == Map) {
+#ifndef _WIN32
+		Track->Mapped = 1;
+#endif
+		return 1;
+	}
+
+#ifdef _WIN32
+	free(Map);
+#else
+	munmap(Map, Size);
+#endif
+	return Ok;
+}
+
+void WriteCacheFile(const char* Name, const void* Data, size_t Size)
+{
+	char* Temp;
+	size_t TempLen;
+	unsigned Count;
+	FILE* Out;
+	int Ok;
+
+	pthread_mutex_lock(&TempLock);
+	Count = TempCount++;
+	pthread_mutex_unlock(&TempLock);
+	TempLen = strlen(Name) + 32;
+	Temp = (char*) malloc(TempLen);
+	if (Temp == NULL)
+		return;
+	snprintf(Temp, TempLen, "%s.%lu.%u", Name, (unsigned long) getpid(), Count);
+
+	if (CacheDir)
+		mkdir(CacheDir, 0777);
+	Out = fopen(Temp, "wb");
+	if (Out) {
+		Ok = fwrite(Data, 1, Size, Out) == Size;
+		Ok = (fclose(Out) == 0) && Ok;
+		/* Windows won't rename over an existing file */
+		if (Ok && rename(Temp, Name) != 0) {
+			remove(Name);
+			Ok = rename(Temp, Name) == 0;
+		}
+		if (!Ok)
+			remove(Temp);
+	}
+
+	free(Temp);
+}
+
+/* Writes the cache file for a track. */
+static void WriteCache(const char* Name, const struct FileId* Id,
+		const struct GPSTrack* Track)
+{
+	struct CacheHeader H;
+	struct CacheLayout L;
+	char* Image;
+	size_t N = Track->NumPoints;
+	size_t i;
+
+	if (!GetLayout(N, (uint32_t) strlen(Id->Path), &L))
+		return;
+	Image = (char*) calloc(1, L.Size);
+	if (Image == NULL)
+		return;
+
+	memset(&H, 0, sizeof(H));
+	memcpy(H.Magic, CACHE_MAGIC, sizeof(H.Magic));
+	H.Version = CACHE_VERSION;
+	H.ByteOrder = CACHE_ORDER;
+	H.FileSize = Id->Size;
+	H.FileTime = Id->Time;
+	H.FileHash = Id->Hash;
+	H.NumPoints = N;
+	H.MinTime = (int64_t) Track->MinTime;
+	H.MaxTime = (int64_t) Track->MaxTime;
+	H.NameLen = (uint32_t) strlen(Id->Path);
+	memcpy(Image, &H, sizeof(H));
+	memcpy(Image + L.Name, Id->Path, H.NameLen);
+
+	for (i = 0; i < N; i++)
+		((int64_t*) (Image + L.Time))[i] = (int64_t) Track->Time[i];
+	if (N > 0) {
+		memcpy(Image + L.Lat, Track->Lat, N * sizeof(double));
+		memcpy(Image + L.Long, Track->Long, N * sizeof(double));
+		memcpy(Image + L.Elev, Track->Elev, N * sizeof(double));
+		memcpy(Image + L.LatDecimals, Track->LatDecimals, N);
+		memcpy(Image + L.LongDecimals, Track->LongDecimals, N);
+		memcpy(Image + L.ElevDecimals, Track->ElevDecimals, N);
+		memcpy(Image + L.SegmentEnd, Track->SegmentEnd, (N + 7) / 8);
+	}
+
+	WriteCacheFile(Name, Image, L.Size);
+	free(Image);
+}
+
+int ReadCachedTrack(const char* File, struct GPSTrack* Track)
+{
+	struct FileId Id;
+	char* Name;
+	int Ok;
+
+	/* If the file can't be read, let ReadTrackFile say so. */
+	if (!CacheEnabled || !IdentifyFile(File, &Id))
+		return ReadTrackFile(File, Track);
+
+	Name = CacheName(File, Id.Path);
+	if (Name && LoadCache(Name, &Id, Track)) {
+		Ok = 1;
+	} else {
+		Ok = ReadTrackFile(File, Track);
+		if (Ok && Name)
+			WriteCache(Name, &Id, Track);
+	}
+
+	free(Name);
+	free(Id.Path);
+	return Ok;
+}
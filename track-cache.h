@@ -0,0 +1,49 @@
+/* track-cache.h
+ * This file contains prototypes for the functions
+ * in track-cache.c.
+ */
+
+/* Copyright 2026 the gpscorrelate authors.
+ *
+ * This file is part of gpscorrelate.
+ *
+ * gpscorrelate is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * gpscorrelate is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with gpscorrelate; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <stddef.h>
+
+struct GPSTrack;
+
+/* Turns on caching of the tracks read from files. If Dir is NULL, each
+ * cache file is put next to the file it was made from, otherwise
+ * they all go into Dir. This must be called before any tracks are read. */
+void SetTrackCache(const char* Dir);
+
+/* Reads a track file into Track just as ReadTrackFile does, but if
+ * caching is turned on, loads it from an up to date cache file instead
+ * when there is one, or writes one for next time when there isn't. */
+int ReadCachedTrack(const char* File, struct GPSTrack* Track);
+
+/* Returns the name of the cache file to keep for File (which may also be
+ * a directory), which must be freed by the caller, or NULL if caching is
+ * turned off. The full name of File is returned in Path, to be freed by
+ * the caller too, so the cache can check that it's really for File. */
+char* TrackCacheName(const char* File, char** Path);
+
+/* Writes Size bytes of Data as the cache file Name. It's written under a
+ * temporary name first, so a cache file is never seen half written. It
+ * doesn't matter if it can't be written at all; whatever it was made from
+ * will just be read again next time. */
+void WriteCacheFile(const char* Name, const void* Data, size_t Size);
@@ -0,0 +1,364 @@
+/* track-index.c
+ * This file contains routines for finding which of all the loaded
+ * tracks, and which segment of it, a photo should be matched against.
+ *
+ * Each track segment (or each track, when matching between segments)
+ * becomes a span with the earliest and latest times of its points.
+ * The spans are then swept through in order of time to split the time
+ * line up into pieces, each covered by a single span, so looking up a
+ * photo is a binary search however many tracks there are.
+ *
+ * A coverage map, with a bit for each minute, then rules out most photos
+ * that can't match without even that: those taken while nothing was
+ * logging, and those too far from any point.
+ */
+
+/* Copyright 2026 the gpscorrelate authors.
+ *
+ * This file is part of gpscorrelate.
+ *
+ * gpscorrelate is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * gpscorrelate is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with gpscorrelate; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "gpsstructure.h"
+#include "track-index.h"
+
+/* Longest time a coverage map is made for, about 32 years */
+#define MAX_COVERAGE_MINUTES ((size_t) 1 << 24)
+
+/* A span waiting to be reached by the sweep */
+struct SpanStart {
+	int64_t Start;
+	size_t Span;
+};
+
+/* Goes through the spans of a track, filling them in at the end of the
+ * index if Index isn't NULL. Returns how many there are. */
+static size_t AddSpans(struct TrackIndex* Index, int TrackNum,
+		const struct GPSTrack* Track, int BetweenSegments)
+{
+	size_t Count = 0;
+	size_t First = 0;
+	size_t i;
+	time_t Min = 0;
+	time_t Max = 0;
+
+	for (i = 0; i < Track->NumPoints; i++)
+	{
+		time_t Time = TRACK_TIME(Track, i);
+		if (i == First || Time < Min)
+			Min = Time;
+		if (i == First || Time > Max)
+			Max = Time;
+		if (i + 1 < Track->NumPoints &&
+		    (BetweenSegments || !IS_SEGMENT_END(Track, i)))
+			continue;
+
+		if (Index) {
+			struct TrackSpan* S = &Index->Spans[Index->NumSpans++];
+			S->Start = Min;
+			S->End = Max;
+			S->Track = TrackNum;
+			S->First = First;
+			S->Past = i + 1;
+		}
+		Count++;
+		First = i + 1;
+	}
+	return Count;
+}
+
+static int CompareSpanStarts(const void* A, const void* B)
+{
+	const struct SpanStart* SA = (const struct SpanStart*) A;
+	const struct SpanStart* SB = (const struct SpanStart*) B;
+
+	if (SA->Start != SB->Start)
+		return SA->Start < SB->Start ? -1 : 1;
+	if (SA->Span != SB->Span)
+		return SA->Span < SB->Span ? -1 : 1;
+	return 0;
+}
+
+static int CompareTimes(const void* A, const void* B)
+{
+	int64_t TA = *(const int64_t*) A;
+	int64_t TB = *(const int64_t*) B;
+
+	if (TA < TB)
+		return -1;
+	return TA > TB;
+}
+
+/* The spans the sweep is in are kept in a heap with the earliest span
+ * on top, since that's the one that wins. */
+static void PushSpan(size_t* Heap, size_t* Size, size_t Span)
+{
+	size_t i = (*Size)++;
+
+	while (i > 0 && Heap[(i - 1) / 2] > Span) {
+		Heap[i] = Heap[(i - 1) / 2];
+		i = (i - 1) / 2;
+	}
+	Heap[i] = Span;
+}
+
+static void PopSpan(size_t* Heap, size_t* Size)
+{
+	size_t Last = Heap[--*Size];
+	size_t i = 0;
+
+	for (;;) {
+		size_t Child = 2 * i + 1;
+		if (Child >= *Size)
+			break;
+		if (Child + 1 < *Size && Heap[Child + 1] < Heap[Child])
+			Child++;
+		if (Heap[Child] >= Last)
+			break;
+		Heap[i] = Heap[Child];
+		i = Child;
+	}
+	Heap[i] = Last;
+}
+
+/* Returns the minute Time is in, rounding down */
+static int64_t MinuteOf(int64_t Time)
+{
+	return Time >= 0 ? Time / 60 : (Time - 59) / 60;
+}
+
+/* Sets the bits in a coverage map for the minutes From to To */
+static void MarkMinutes(unsigned char* Map, int64_t FirstMinute,
+		int64_t From, int64_t To)
+{
+	size_t i = (size_t) (MinuteOf(From) - FirstMinute);
+	size_t Last = (size_t) (MinuteOf(To) - FirstMinute);
+
+	while (i <= Last) {
+		if (i % 8 == 0 && Last - i >= 7) {
+			size_t Bytes = (Last - i + 1) / 8;
+			memset(Map + i / 8, 0xff, Bytes);
+			i += Bytes * 8;
+		} else {
+			Map[i / 8] |= (unsigned char) (1 << (i % 8));
+			i++;
+		}
+	}
+}
+
+/* Makes the coverage map of an index whose spans are done. A photo can
+ * only be too far from the points of a span whose times are in order,
+ * and then only if it's more than FeatherTime from both of the points
+ * it's between. Everywhere else in a span might match. Since the first
+ * and last points of every span are marked, a minute that isn't is
+ * either in no span or wholly inside the spans that cover any of it. */
+static int BuildCoverage(struct TrackIndex* Index, const struct GPSTrack* Tracks,
+		int FeatherTime)
+{
+	int64_t First, Last;
+	size_t Bytes;
+	size_t s, i;
+
+	First = MinuteOf(Index->Spans[0].Start);
+	Last = MinuteOf(Index->Spans[0].End);
+	for (s = 1; s < Index->NumSpans; s++)
+	{
+		if (MinuteOf(Index->Spans[s].Start) < First)
+			First = MinuteOf(Index->Spans[s].Start);
+		if (MinuteOf(Index->Spans[s].End) > Last)
+			Last = MinuteOf(Index->Spans[s].End);
+	}
+	if ((uint64_t) (Last - First) >= MAX_COVERAGE_MINUTES)
+		return 1;
+
+	Index->FirstMinute = First;
+	Index->NumMinutes = (size_t) (Last - First) + 1;
+	Bytes = (Index->NumMinutes + 7) / 8;
+	Index->MayMatch = (unsigned char*) calloc(2, Bytes);
+	if (!Index->MayMatch)
+		return 0;
+	Index->InSpan = Index->MayMatch + Bytes;
+	Index->CoverageBytes = 2 * Bytes;
+
+	for (s = 0; s < Index->NumSpans; s++)
+	{
+		const struct TrackSpan* Span = &Index->Spans[s];
+		const struct GPSTrack* Track = &Tracks[Span->Track];
+		int InOrder = 1;
+
+		MarkMinutes(Index->InSpan, First, Span->Start, Span->End);
+		for (i = Span->First + 1; i < Span->Past && InOrder; i++)
+			if (TRACK_TIME(Track, i) < TRACK_TIME(Track, i - 1))
+				InOrder = 0;
+		if (!InOrder || FeatherTime <= 0)
+		{
+			MarkMinutes(Index->MayMatch, First, Span->Start, Span->End);
+			continue;
+		}
+
+		for (i = Span->First; i < Span->Past; i++)
+		{
+			int64_t A = TRACK_TIME(Track, i);
+			int64_t B;
+
+			MarkMinutes(Index->MayMatch, First, A, A);
+			if (i + 1 == Span->Past)
+				break;
+			B = TRACK_TIME(Track, i + 1);
+			if (B == A)
+				continue;
+			MarkMinutes(Index->MayMatch, First, A,
+				    B - A > FeatherTime ? A + FeatherTime : B);
+			MarkMinutes(Index->MayMatch, First,
+				    B - A > FeatherTime ? B - FeatherTime : A, B);
+		}
+	}
+	return 1;
+}
+
+int BuildTrackIndex(struct TrackIndex* Index, const struct GPSTrack* Tracks,
+		int BetweenSegments, int FeatherTime)
+{
+	struct SpanStart* Starts;
+	size_t* Heap;
+	size_t HeapSize = 0;
+	size_t NumSpans = 0;
+	size_t NumEdges = 0;
+	size_t i, j;
+	int TrackNum;
+
+	memset(Index, 0, sizeof(*Index));
+	for (TrackNum = 0; Tracks[TrackNum].NumPoints; TrackNum++)
+		NumSpans += AddSpans(NULL, TrackNum, &Tracks[TrackNum],
+				     BetweenSegments);
+	if (NumSpans == 0)
+		return 1;
+
+	/* Each span can start one piece of the time line and end another */
+	Index->Spans = (struct TrackSpan*) malloc(NumSpans * sizeof(*Index->Spans));
+	Index->Breaks = (int64_t*) malloc(2 * NumSpans * sizeof(*Index->Breaks));
+	Index->Covering = (long*) malloc(2 * NumSpans * sizeof(*Index->Covering));
+	Starts = (struct SpanStart*) malloc(NumSpans * sizeof(*Starts));
+	Heap = (size_t*) malloc(NumSpans * sizeof(*Heap));
+	if (!Index->Spans || !Index->Breaks || !Index->Covering || !Starts || !Heap)
+	{
+		free(Starts);
+		free(Heap);
+		FreeTrackIndex(Index);
+		return 0;
+	}
+
+	for (TrackNum = 0; Tracks[TrackNum].NumPoints; TrackNum++)
+		AddSpans(Index, TrackNum, &Tracks[TrackNum], BetweenSegments);
+
+	for (i = 0; i < NumSpans; i++)
+	{
+		Starts[i].Start = Index->Spans[i].Start;
+		Starts[i].Span = i;
+		Index->Breaks[NumEdges++] = Index->Spans[i].Start;
+		if (Index->Spans[i].End < INT64_MAX)
+			Index->Breaks[NumEdges++] = Index->Spans[i].End + 1;
+	}
+	qsort(Starts, NumSpans, sizeof(*Starts), CompareSpanStarts);
+	qsort(Index->Breaks, NumEdges, sizeof(*Index->Breaks), CompareTimes);
+
+	/* Sweep through the breaks, keeping track of the spans that have
+	 * started. Those that have ended are only dropped once they get to
+	 * the top of the heap, since only the top one matters. */
+	j = 0;
+	for (i = 0; i < NumEdges; i++)
+	{
+		int64_t Break = Index->Breaks[i];
+		long Span;
+
+		if (i > 0 && Break == Index->Breaks[i - 1])
+			continue;
+		while (j < NumSpans && Starts[j].Start <= Break)
+			PushSpan(Heap, &HeapSize, Starts[j++].Span);
+		while (HeapSize && Index->Spans[Heap[0]].End < Break)
+			PopSpan(Heap, &HeapSize);
+		Span = HeapSize ? (long) Heap[0] : -1;
+
+		/* Pieces next to each other covered by the same span are
+		 * one piece. */
+		if (Index->NumBreaks && Index->Covering[Index->NumBreaks - 1] == Span)
+			continue;
+		Index->Breaks[Index->NumBreaks] = Break;
+		Index->Covering[Index->NumBreaks] = Span;
+		Index->NumBreaks++;
+	}
+
+	free(Starts);
+	free(Heap);
+
+	if (!BuildCoverage(Index, Tracks, FeatherTime))
+	{
+		FreeTrackIndex(Index);
+		return 0;
+	}
+	return 1;
+}
+
+int CheckCoverage(const struct TrackIndex* Index, time_t Time)
+{
+	int64_t Minute = MinuteOf(Time);
+	size_t i;
+
+	if (!Index->MayMatch)
+		return COVERAGE_UNKNOWN;
+	if (Minute < Index->FirstMinute ||
+	    (uint64_t) (Minute - Index->FirstMinute) >= Index->NumMinutes)
+		return COVERAGE_OUTSIDE;
+
+	i = (size_t) (Minute - Index->FirstMinute);
+	if ((Index->MayMatch[i / 8] >> (i % 8)) & 1)
+		return COVERAGE_UNKNOWN;
+	if ((Index->InSpan[i / 8] >> (i % 8)) & 1)
+		return COVERAGE_GAP;
+	return COVERAGE_OUTSIDE;
+}
+
+const struct TrackSpan* FindTrackSpan(const struct TrackIndex* Index,
+		time_t Time)
+{
+	size_t Low = 0;
+	size_t High = Index->NumBreaks;
+
+	/* Find the first break after Time. The piece before it is the one
+	 * Time is in. */
+	while (Low < High) {
+		size_t Middle = Low + (High - Low) / 2;
+		if (Index->Breaks[Middle] <= (int64_t) Time)
+			Low = Middle + 1;
+		else
+			High = Middle;
+	}
+	if (Low == 0 || Index->Covering[Low - 1] < 0)
+		return NULL;
+	return &Index->Spans[Index->Covering[Low - 1]];
+}
+
+void FreeTrackIndex(struct TrackIndex* Index)
+{
+	free(Index->Spans);
+	free(Index->Breaks);
+	free(Index->Covering);
+	free(Index->MayMatch);
+	memset(Index, 0, sizeof(*Index));
+}
@@ -0,0 +1,94 @@
+/* track-index.h
+ * This file contains prototypes for the functions
+ * in track-index.c.
+ */
+
+/* Copyright 2026 the gpscorrelate authors.
+ *
+ * This file is part of gpscorrelate.
+ *
+ * gpscorrelate is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * gpscorrelate is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with gpscorrelate; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct GPSTrack;
+
+/* A run of points in one track that a photo can be matched within:
+ * a track segment, or a whole track if photos are to be matched
+ * between its segments. */
+struct TrackSpan {
+	int64_t Start;		/* Earliest time of its points */
+	int64_t End;		/* Latest time of its points */
+	int Track;		/* Which of the tracks it's in */
+	size_t First;		/* Its first point */
+	size_t Past;		/* One past its last point */
+};
+
+/* The spans of all the tracks, with the times split up by which span
+ * a photo taken at that time belongs to. Where spans overlap, the
+ * earliest one, in order of track and then of point, wins. */
+struct TrackIndex {
+	struct TrackSpan* Spans;
+	size_t NumSpans;
+	int64_t* Breaks;	/* When the winning span changes, in order */
+	long* Covering;		/* Span from each break to the next, or -1 */
+	size_t NumBreaks;
+
+	/* The coverage map has a bit for each minute from FirstMinute on,
+	 * in each of two bitmaps: one set if a photo taken then might
+	 * match, and one set if any span covers it. It's left out if the
+	 * tracks cover too long a time. */
+	unsigned char* MayMatch;
+	unsigned char* InSpan;
+	int64_t FirstMinute;
+	size_t NumMinutes;
+	size_t CoverageBytes;	/* Size of both bitmaps */
+};
+
+/* What the coverage map says about a photo */
+#define COVERAGE_UNKNOWN 0	/* It might match; search the span */
+#define COVERAGE_OUTSIDE 1	/* No span covers it */
+#define COVERAGE_GAP     2	/* It's too far from the points of its span */
+
+/* Builds an index of the spans of Tracks, an array whose last entry has
+ * no points. If BetweenSegments is set, each track is one span;
+ * otherwise each track segment is. FeatherTime is the most seconds a
+ * photo between two points can be from one of them, or 0 for no limit,
+ * as for correlating. Returns 0 if there's no memory for it. */
+int BuildTrackIndex(struct TrackIndex* Index, const struct GPSTrack* Tracks,
+		int BetweenSegments, int FeatherTime);
+
+/* Returns what the coverage map says about a photo taken at Time: one
+ * of the COVERAGE_ values. */
+int CheckCoverage(const struct TrackIndex* Index, time_t Time);
+
+/* Returns the span a photo taken at Time belongs to, or NULL if no span
+ * covers that time. */
+const struct TrackSpan* FindTrackSpan(const struct TrackIndex* Index,
+		time_t Time);
+
+/* Frees an index, leaving it empty. */
+void FreeTrackIndex(struct TrackIndex* Index);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,321 @@
+/* track-load.c
+ * This file contains routines for reading a number of GPS track files
+ * at once, each on its own worker thread.
+ *
+ * The files are handed out to the workers in order, and the results are
+ * collected in order by the calling thread. Any messages a worker has to
+ * give about a file (including those from libxml) are held back until
+ * the caller gets to that file, so the output is just as if the files
+ * had been read one after another.
+ */
+
+/* Copyright 2026 the gpscorrelate authors.
+ *
+ * This file is part of gpscorrelate.
+ *
+ * gpscorrelate is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * gpscorrelate is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with gpscorrelate; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <libxml/parser.h>
+#include <libxml/xmlerror.h>
+
+#include "track-load.h"
+#include "gpx-read.h"
+#include "track-cache.h"
+#include "nmea-read.h"
+#include "fit-read.h"
+#include "takeout-read.h"
+#include "gpmf-read.h"
+#include "photo-track.h"
+#include "decompress.h"
+#include "gpsstructure.h"
+
+/* Most threads to read files on */
+#define MAX_THREADS 64
+
+struct Job {
+	char* File;
+	struct GPSTrack* Track;
+	int Ok;
+	int Done;
+	char* Messages;		/* Held back messages, or NULL */
+	size_t MessagesLen;
+};
+
+struct Pool {
+	struct Job* Jobs;
+	int NumJobs;
+	int Next;		/* Next job to hand out */
+	int Stop;		/* Set once no more jobs are wanted */
+	pthread_mutex_t Lock;
+	pthread_cond_t Finished;
+};
+
+/* Whether to make the tracks read in compact */
+static int CompactTracks = 0;
+
+/* Each worker thread points this at the job it's on */
+static pthread_key_t CurrentJob;
+static pthread_once_t CurrentJobOnce = PTHREAD_ONCE_INIT;
+
+static void MakeCurrentJob(void)
+{
+	pthread_key_create(&CurrentJob, NULL);
+}
+
+long NumCPUs(void)
+{
+#ifdef _SC_NPROCESSORS_ONLN
+	return sysconf(_SC_NPROCESSORS_ONLN);
+#else
+	return 1;
+#endif
+}
+
+void SetCompactTracks(int Compact)
+{
+	CompactTracks = Compact;
+}
+
+/* Reads a track for ReadTracks, making it compact if wanted. A track that
+ * can't be made compact is simply kept as it is. */
+static int ReadOneTrack(const char* File, struct GPSTrack* Track)
+{
+	if (!ReadCachedTrack(File, Track))
+		return 0;
+	if (CompactTracks)
+		CompactTrack(Track);
+	return 1;
+}
+
+int ReadTrackFile(const char* File, struct GPSTrack* Track)
+{
+	char Start[256];
+	int Len;
+
+	if (IsPhotoDirectory(File))
+		return ReadPhotoTrack(File, Track);
+
+	/* Anything that isn't recognised is taken to be GPX, so any errors
+	 * are reported as they always have been. */
+	Len = PeekFile(File, Start, sizeof(Start));
+	if (Len > 0 && IsFIT(Start, (size_t) Len))
+		return ReadFIT(File, Track);
+	if (Len > 0 && IsNMEA(Start, (size_t) Len))
+		return ReadNMEA(File, Track);
+	if (Len > 0 && IsTakeout(Start, (size_t) Len))
+		return ReadTakeout(File, Track);
+	if (Len > 0 && IsMP4(Start, (size_t) Len))
+		return ReadGPMF(File, Track);
+	return ReadGPX(File, Track);
+}
+
+/* Adds a message to those held back for a job. */
+static void AddMessage(struct Job* J, const char* Format, va_list Args)
+{
+	va_list Copy;
+	char* Messages;
+	int Len;
+
+	va_copy(Copy, Args);
+	Len = vsnprintf(NULL, 0, Format, Copy);
+	va_end(Copy);
+	if (Len <= 0)
+		return;
+
+	Messages = (char*) realloc(J->Messages, J->MessagesLen + Len + 1);
+	if (!Messages)
+		return;
+	J->Messages = Messages;
+	vsnprintf(J->Messages + J->MessagesLen, Len + 1, Format, Args);
+	J->MessagesLen += Len;
+}
+
+void TrackReadError(const char* Format, ...)
+{
+	struct Job* J;
+	va_list Args;
+
+	pthread_once(&CurrentJobOnce, MakeCurrentJob);
+	J = (struct Job*) pthread_getspecific(CurrentJob);
+
+	va_start(Args, Format);
+	if (J)
+		AddMessage(J, Format, Args);
+	else
+		vfprintf(stderr, Format, Args);
+	va_end(Args);
+}
+
+/* Takes the place of libxml's own error handler in the worker threads. */
+static void XMLError(void* Context, const char* Format, ...)
+{
+	struct Job* J = (struct Job*) pthread_getspecific(CurrentJob);
+	va_list Args;
+
+	(void) Context;
+	va_start(Args, Format);
+	if (J)
+		AddMessage(J, Format, Args);
+	else
+		vfprintf(stderr, Format, Args);
+	va_end(Args);
+}
+
+static void* ReadWorker(void* Arg)
+{
+	struct Pool* P = (struct Pool*) Arg;
+	struct Job* J;
+
+	/* This only affects the current thread. */
+	xmlSetGenericErrorFunc(NULL, XMLError);
+
+	for (;;) {
+		pthread_mutex_lock(&P->Lock);
+		while (P->Next < P->NumJobs && !P->Jobs[P->Next].File)
+			P->Next++;
+		if (P->Stop || P->Next >= P->NumJobs) {
+			pthread_mutex_unlock(&P->Lock);
+			break;
+		}
+		J = &P->Jobs[P->Next++];
+		pthread_mutex_unlock(&P->Lock);
+
+		pthread_setspecific(CurrentJob, J);
+		J->Ok = ReadOneTrack(J->File, J->Track);
+		pthread_setspecific(CurrentJob, NULL);
+
+		pthread_mutex_lock(&P->Lock);
+		J->Done = 1;
+		pthread_cond_broadcast(&P->Finished);
+		pthread_mutex_unlock(&P->Lock);
+	}
+
+	xmlSetGenericErrorFunc(NULL, NULL);
+	return NULL;
+}
+
+int ReadTracks(char** Files, int NumFiles, struct GPSTrack* Tracks,
+		ReadTracksProgress Progress)
+{
+	pthread_t Threads[MAX_THREADS];
+	struct Pool P;
+	long NumThreads;
+	int Started;
+	int Failed;
+	int i;
+
+	pthread_once(&CurrentJobOnce, MakeCurrentJob);
+
+	NumThreads = 0;
+	for (i = 0; i < NumFiles; i++)
+		if (Files[i])
+			NumThreads++;
+	if (NumThreads > NumCPUs())
+		NumThreads = NumCPUs();
+	if (NumThreads > MAX_THREADS)
+		NumThreads = MAX_THREADS;
+
+	memset(&P, 0, sizeof(P));
+	Started = 0;
+	if (NumThreads > 1) {
+		P.Jobs = (struct Job*) calloc(NumFiles, sizeof(*P.Jobs));
+		P.NumJobs = NumFiles;
+	}
+
+	if (P.Jobs) {
+		for (i = 0; i < NumFiles; i++) {
+			P.Jobs[i].File = Files[i];
+			P.Jobs[i].Track = &Tracks[i];
+		}
+		pthread_mutex_init(&P.Lock, NULL);
+		pthread_cond_init(&P.Finished, NULL);
+
+		/* libxml has to be set up before any threads use it. */
+		xmlInitParser();
+
+		for (Started = 0; Started < NumThreads; Started++)
+			if (pthread_create(&Threads[Started], NULL, ReadWorker, &P) != 0)
+				break;
+
+		/* If no threads could be started, the files will just have
+		 * to be read here instead. */
+		for (i = 0; Started > 0 && i < NumFiles; i++) {
+			if (!Files[i])
+				continue;
+			if (Progress)
+				Progress(Files[i], 0);
+
+			pthread_mutex_lock(&P.Lock);
+			while (!P.Jobs[i].Done)
+				pthread_cond_wait(&P.Finished, &P.Lock);
+			pthread_mutex_unlock(&P.Lock);
+
+			if (P.Jobs[i].Messages) {
+				fputs(P.Jobs[i].Messages, stderr);
+				fflush(stderr);
+			}
+			if (Progress)
+				Progress(Files[i], 1);
+			if (!P.Jobs[i].Ok)
+				break;
+		}
+		Failed = i;
+
+		pthread_mutex_lock(&P.Lock);
+		P.Stop = 1;
+		pthread_mutex_unlock(&P.Lock);
+		for (i = 0; i < Started; i++)
+			pthread_join(Threads[i], NULL);
+
+		/* Throw away whatever was read after a failure */
+		for (i = 0; i < NumFiles; i++) {
+			if (Started > 0 && i > Failed && P.Jobs[i].Done && P.Jobs[i].Ok) {
+				FreeTrack(&Tracks[i]);
+				memset(&Tracks[i], 0, sizeof(Tracks[i]));
+			}
+			free(P.Jobs[i].Messages);
+		}
+
+		pthread_cond_destroy(&P.Finished);
+		pthread_mutex_destroy(&P.Lock);
+		free(P.Jobs);
+
+		if (Started > 0)
+			return Failed;
+	}
+
+	/* Read them one by one. */
+	for (i = 0; i < NumFiles; i++) {
+		int Ok;
+
+		if (!Files[i])
+			continue;
+		if (Progress)
+			Progress(Files[i], 0);
+		Ok = ReadOneTrack(Files[i], &Tracks[i]);
+		if (Progress)
+			Progress(Files[i], 1);
+		if (!Ok)
+			return i;
+	}
+	return NumFiles;
+}
@@ -0,0 +1,57 @@
+/* track-load.h
+ * This file contains prototypes for the functions
+ * in track-load.c.
+ */
+
+/* Copyright 2026 the gpscorrelate authors.
+ *
+ * This file is part of gpscorrelate.
+ *
+ * gpscorrelate is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * gpscorrelate is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with gpscorrelate; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+struct GPSTrack;
+
+/* Called for each file in turn as ReadTracks gets to it: once with Done
+ * set to 0 before any messages from reading the file are printed, then
+ * again with Done set to 1 afterward. */
+typedef void (*ReadTracksProgress)(const char* File, int Done);
+
+/* Reads each of the NumFiles track files named in Files into the matching
+ * entry of Tracks, several files at a time. Entries whose name is NULL
+ * are skipped and left alone. Messages are printed in the same order as
+ * if the files had been read one after another, and reading stops at
+ * the first file that fails. Returns the index of that file, with the
+ * tracks for it and any later files left zeroed, or NumFiles if all went
+ * well. */
+int ReadTracks(char** Files, int NumFiles, struct GPSTrack* Tracks,
+		ReadTracksProgress Progress);
+
+/* Makes ReadTracks turn each track into a compact one once it has been
+ * read, using much less memory for big tracks at the cost of some of the
+ * decimal places. See CompactTrack. */
+void SetCompactTracks(int Compact);
+
+/* Reads the track from a single file, in whichever of the supported
+ * formats it's in (GPX, NMEA 0183, FIT, Google location history or GoPro
+ * MP4), or from a directory of geotagged photos. Returns 1 on success. */
+int ReadTrackFile(const char* File, struct GPSTrack* Track);
+
+/* Prints an error message about the file being read. While ReadTracks
+ * is running, the message is held back until it is this file's turn. */
+void TrackReadError(const char* Format, ...);
+
+/* Returns the number of CPUs available to run threads on. */
+long NumCPUs(void);
@@ -29,9 +29,14 @@
 #include <stdio.h>
 #include <time.h>
 #include <string.h>
+#include <pthread.h>
 
 #include "unixtime.h"
 
+/* TZ is shared by all threads, so only one can change it or depend on it
+ * at a time */
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
 #ifdef _WIN32
 /* Unfortunately, portable_timegm below isn't portable to Windows */
 #define portable_timegm _mkgmtime
@@ -43,6 +48,7 @@ static time_t portable_timegm(struct tm *tm)
 {
 	static const char *tz;
 
+	pthread_mutex_lock(&lock);
         if (!tz) {
 		tz = getenv("TZ");
 		if (tz)
@@ -62,6 +68,7 @@ static time_t portable_timegm(struct tm *tm)
 	else
 	   unsetenv("TZ");
 	tzset();
+	pthread_mutex_unlock(&lock);
 	return ret;
 }
 #endif
@@ -108,3 +115,151 @@ time_t ConvertToUnixTime(const char* StringTime, const char* Format,
 	return thetime;
 }
 
+long LocalTimeOffset(time_t LocalTime)
+{
+	struct tm Tm;
+	time_t RealTime;
+
+	pthread_mutex_lock(&lock);
+	/* Extract the component time values */
+	Tm = *gmtime(&LocalTime);
+
+	/* Then create a true epoch-based local time, including DST */
+	Tm.tm_isdst = -1;
+	RealTime = mktime(&Tm);
+	pthread_mutex_unlock(&lock);
+
+	return (long) (LocalTime - RealTime);
+}
+
+
+/* Returns the number of days from 1970-01-01 to the given date in the
+ * proleptic Gregorian calendar. The month must be from 1 to 12, but the
+ * day can be anything, just as for mktime. */
+static long long DaysFromCivil(long long Year, int Month, long long Day)
+{
+	/* Count years from March, so the leap day comes at the end */
+	if (Month <= 2)
+		Year -= 1;
+	long long Era = (Year >= 0 ? Year : Year - 399) / 400;
+	long long YearOfEra = Year - Era * 400;
+	long long DayOfYear = (153 * (Month > 2 ? Month - 3 : Month + 9) + 2) / 5 + Day - 1;
+	long long DayOfEra = YearOfEra * 365 + YearOfEra / 4 - YearOfEra / 100 + DayOfYear;
+
+	/* 719468 is the number of days from 0000-03-01 to 1970-01-01 */
+	return Era * 146097 + DayOfEra - 719468;
+}
+
+/* Reads a number of between MinDigits and MaxDigits digits. Returns the
+ * position just after it, or NULL if there isn't one. */
+static const char* ReadDigits(const char* Pos, const char* End,
+		int MinDigits, int MaxDigits, long* Value)
+{
+	int Digits = 0;
+
+	*Value = 0;
+	while (Pos < End && *Pos >= '0' && *Pos <= '9' && Digits < MaxDigits)
+	{
+		*Value = *Value * 10 + (*Pos++ - '0');
+		++Digits;
+	}
+	return Digits >= MinDigits ? Pos : NULL;
+}
+
+static int IsTimeSpace(char c)
+{
+	return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+int ConvertGPXTime(const char* StringTime, size_t Length, time_t* Time)
+{
+	/* The string must look like YYYY-MM-DDThh:mm:ss, optionally
+	 * followed by fractional seconds and then either Z or a +hh:mm or
+	 * -hh:mm offset from UTC. The fields don't have to be padded out to
+	 * their full width, as sscanf never required that either. If there
+	 * is no time zone, the time is taken to be UTC. */
+	const char* Pos = StringTime;
+	const char* End = StringTime + Length;
+	long Year, Month, Day, Hour, Min, Sec;
+	long OffsetHours = 0, OffsetMins = 0;
+	int OffsetSign = 0;
+
+	if (StringTime == NULL)
+		return 0;
+
+	/* libxml hands over the element content as it is, spaces and all */
+	while (Pos < End && IsTimeSpace(*Pos))
+		++Pos;
+	while (End > Pos && IsTimeSpace(End[-1]))
+		--End;
+
+	if (!(Pos = ReadDigits(Pos, End, 1, 9, &Year)) || Pos == End || *Pos++ != '-' ||
+	    !(Pos = ReadDigits(Pos, End, 1, 2, &Month)) || Pos == End || *Pos++ != '-' ||
+	    !(Pos = ReadDigits(Pos, End, 1, 2, &Day)) || Pos == End ||
+	    (*Pos != 'T' && *Pos != 't') ||
+	    !(Pos = ReadDigits(Pos + 1, End, 1, 2, &Hour)) || Pos == End || *Pos++ != ':' ||
+	    !(Pos = ReadDigits(Pos, End, 1, 2, &Min)) || Pos == End || *Pos++ != ':' ||
+	    !(Pos = ReadDigits(Pos, End, 1, 2, &Sec)))
+	{
+		return 0;
+	}
+
+	/* Fractions of a second are dropped, as they always have been */
+	if (Pos < End && (*Pos == '.' || *Pos == ','))
+	{
+		++Pos;
+		if (Pos == End || *Pos < '0' || *Pos > '9')
+			return 0;
+		while (Pos < End && *Pos >= '0' && *Pos <= '9')
+			++Pos;
+	}
+
+	/* Then the time zone */
+	if (Pos < End && (*Pos == 'Z' || *Pos == 'z'))
+	{
+		++Pos;
+	} else if (Pos < End && (*Pos == '+' || *Pos == '-'))
+	{
+		OffsetSign = (*Pos == '-') ? -1 : 1;
+		if (!(Pos = ReadDigits(Pos + 1, End, 2, 2, &OffsetHours)))
+			return 0;
+		if (Pos < End && *Pos == ':')
+		{
+			if (!(Pos = ReadDigits(Pos + 1, End, 2, 2, &OffsetMins)))
+				return 0;
+		} else if (Pos < End && !(Pos = ReadDigits(Pos, End, 2, 2, &OffsetMins)))
+		{
+			return 0;
+		}
+		/* No time zone is further out than +14:00 */
+		if (OffsetHours > 14 || OffsetMins > 59)
+			return 0;
+	}
+	if (Pos != End || Month < 1 || Month > 12)
+		return 0;
+
+	*Time = UTCToUnixTime(Year, (int) Month, Day, Hour, Min, Sec) -
+		OffsetSign * (OffsetHours * 3600L + OffsetMins * 60L);
+	return 1;
+}
+
+int ConvertExifTime(const char* StringTime, time_t* Time)
+{
+	int Year, Month, Day, Hour, Min, Sec;
+
+	if (StringTime == NULL ||
+	    sscanf(StringTime, EXIF_DATE_FORMAT, &Year, &Month, &Day,
+			&Hour, &Min, &Sec) != 6 || Month < 1 || Month > 12)
+		return 0;
+	*Time = UTCToUnixTime(Year, Month, Day, Hour, Min, Sec);
+	return 1;
+}
+
+time_t UTCToUnixTime(long Year, int Month, long Day, long Hour, long Min, long Sec)
+{
+	/* Out of range days and times just carry over, as with mktime */
+	long long Seconds = DaysFromCivil(Year, Month, Day) * 86400LL +
+		Hour * 3600LL + Min * 60LL + Sec;
+
+	return (time_t) Seconds;
+}
@@ -33,3 +33,25 @@
 time_t ConvertToUnixTime(const char* StringTime, const char* Format,
 		int TZOffsetHours, int TZOffsetMinutes);
 
+/* Returns the offset of the local time zone from UTC in seconds, including
+ * any daylight saving, at a local time given as if it were UTC (as returned
+ * by ConvertToUnixTime with no time zone offset). */
+long LocalTimeOffset(time_t LocalTime);
+
+/* Reads an ISO 8601 date and time, as found in GPX files, such as
+ * 2012-11-22T12:34:56Z. Fractions of a second are dropped, and a time
+ * zone offset such as +10:00 is taken into account. Returns 1 and sets
+ * *Time on success, or 0 if the string can't be read. */
+int ConvertGPXTime(const char* StringTime, size_t Length, time_t* Time);
+
+/* Reads a date and time as found in EXIF, such as 2012:11:22 12:34:56,
+ * taking it to be UTC. Unlike ConvertToUnixTime this never touches TZ, so
+ * it's safe to call while other threads are running. Returns 1 and sets
+ * *Time on success, or 0 if the string can't be read. */
+int ConvertExifTime(const char* StringTime, time_t* Time);
+
+/* Returns the time_t for the given UTC date and time. The month must be
+ * from 1 to 12, but the other fields can be out of range, in which case
+ * they carry over just as for mktime. */
+time_t UTCToUnixTime(long Year, int Month, long Day,
+		long Hour, long Min, long Sec);